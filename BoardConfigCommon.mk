@@ -28,6 +28,9 @@ TARGET_32_BIT_SURFACEFLINGER := true
 MALLOC_IMPL := dlmalloc
 BOARD_HAVE_SAMSUNG_T20_HWCOMPOSER := true
 BOARD_TEGRA2_HWC_SET_RT_IOPRIO := true
+# BOARD_TEGRA2_HWC_DC_OVERLAY (video overlay and pointer cursor) also needs
+# the BOARD_TEGRA2_NVGR_* values of the gralloc blob shipped here, see
+# hwc/nvgralloc.h. Off until they have been checked on a device.
 
 OTA_EXTRA_OPTIONS := -r
 
@@ -1,4 +1,4 @@
-# Copyright (C) 2015 The CyanogenMod Project
+# Copyright (C) 2015 The Android Open Source Project
 #
 # Licensed under the Apache License, Version 2.0 (the "License");
 # you may not use this file except in compliance with the License.
@@ -12,20 +12,35 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+ifneq ($(filter p4 p4wifi p4tmo p4vzw, $(TARGET_DEVICE)),)
+
 LOCAL_PATH := $(call my-dir)
 
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := hwrevision.cpp
-
-LOCAL_C_INCLUDES := system/core/init
-
-LOCAL_SHARED_LIBRARIES := libcutils
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_SRC_FILES := \
+    blktune.c \
+    bootsetup.c \
+    entropy.c \
+    macaddr.c \
+    tunables.c \
+    util.c \
+    zram.c
+LOCAL_MODULE := bootsetup
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
 
-LOCAL_STATIC_LIBRARIES := libinit
+# Host test for block tuning, against a fake sysfs tree
+include $(CLEAR_VARS)
 
-LOCAL_MODULE := hwrevision
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_SRC_FILES := \
+    blktune.c \
+    util.c \
+    tests/blktune_test.c
+LOCAL_MODULE := blktune_test
 LOCAL_MODULE_TAGS := optional
-LOCAL_MODULE_PATH := $(TARGET_ROOT_OUT)/sbin
+include $(BUILD_HOST_EXECUTABLE)
 
-include $(BUILD_EXECUTABLE)
+endif
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bootsetup"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "bootsetup.h"
+
+/*
+ * Everything is read and written below blk_root, "" on the device. Pointing
+ * it at a directory holding a fake sys/ and proc/ tree exercises the same
+ * code off the device.
+ */
+static const char *blk_root = "";
+
+#define MAX_DISKS       8
+
+struct queue_profile {
+    const char *disk;
+    const char *read_ahead_kb;
+    const char *nr_requests;
+    const char *rq_affinity;
+};
+
+/*
+ * While booting, /system is read in long runs (framework jars, dex/oat,
+ * libraries) and a deep readahead pays off. Once up, reads are small and
+ * scattered and the same readahead just evicts page cache. Readahead and
+ * the request queue are per disk, shared by every partition on it.
+ */
+static const struct queue_profile boot_profile[] = {
+    { "mmcblk0", "512", "256", "1" },
+};
+
+static const struct queue_profile runtime_profile[] = {
+    { "mmcblk0", "128", "128", "1" },
+};
+
+struct fs_tunable {
+    const char *fs;
+    const char *attr;
+    const char *value;
+};
+
+/*
+ * Per-filesystem knobs for /data. ext4 reads a larger inode table window
+ * on lookups, which helps app start on a full /data. f2fs does in-place
+ * updates only on the fsync path, which SQLite's small synced writes hit.
+ */
+static const struct fs_tunable data_tunables[] = {
+    { "ext4", "inode_readahead_blks", "64" },
+    { "f2fs", "ipu_policy", "16" },
+};
+
+#define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
+
+void blk_set_root(const char *root)
+{
+    blk_root = root;
+}
+
+static int write_attr(const char *dir, const char *attr, const char *value)
+{
+    char path[256];
+    int ret;
+
+    snprintf(path, sizeof(path), "%s%s/%s", blk_root, dir, attr);
+    ret = write_string(path, value);
+    if (ret < 0)
+        ALOGW("%s: %s", path, strerror(-ret));
+    else
+        ALOGV("%s = %s", path, value);
+    return ret;
+}
+
+static int apply_profile(const struct queue_profile *profile, size_t count,
+        const char *phase)
+{
+    char queue[64];
+    size_t i;
+    int failed, ret = 0;
+
+    for (i = 0; i < count; i++) {
+        const struct queue_profile *p = &profile[i];
+
+        /* one attribute failing must not keep the others at their old value */
+        snprintf(queue, sizeof(queue), "/sys/block/%s/queue", p->disk);
+        failed = 0;
+        if (write_attr(queue, "read_ahead_kb", p->read_ahead_kb) < 0)
+            failed++;
+        if (write_attr(queue, "nr_requests", p->nr_requests) < 0)
+            failed++;
+        if (write_attr(queue, "rq_affinity", p->rq_affinity) < 0)
+            failed++;
+
+        if (failed) {
+            ALOGW("%s: %s profile not fully applied", p->disk, phase);
+            ret = -EIO;
+        } else {
+            ALOGI("%s: %s profile, readahead %skB, %s requests", p->disk,
+                    phase, p->read_ahead_kb, p->nr_requests);
+        }
+    }
+
+    return ret;
+}
+
+int setup_blkqueue(void)
+{
+    return apply_profile(boot_profile, ARRAY_SIZE(boot_profile), "boot");
+}
+
+int blk_boot_completed(void)
+{
+    return apply_profile(runtime_profile, ARRAY_SIZE(runtime_profile),
+            "runtime");
+}
+
+/* Finds the device and filesystem mounted at mnt from /proc/mounts. */
+static int find_mount(const char *mnt, char *dev, size_t dev_len,
+        char *fs, size_t fs_len)
+{
+    char path[256], buf[4096];
+    char *line, *save = NULL;
+    ssize_t ret;
+
+    snprintf(path, sizeof(path), "%s/proc/mounts", blk_root);
+    ret = read_file(path, buf, sizeof(buf));
+    if (ret < 0)
+        return ret;
+
+    for (line = strtok_r(buf, "\n", &save); line != NULL;
+            line = strtok_r(NULL, "\n", &save)) {
+        char m_dev[128], m_dir[128], m_fs[32], real[PATH_MAX];
+        const char *name = m_dev;
+
+        if (sscanf(line, "%127s %127s %31s", m_dev, m_dir, m_fs) != 3)
+            continue;
+        if (strcmp(m_dir, mnt))
+            continue;
+
+        /*
+         * /sys/fs/<fs>/ entries are named after the bare block device, and
+         * fstab mounts through the by-name links.
+         */
+        snprintf(path, sizeof(path), "%s%s", blk_root, m_dev);
+        if (realpath(path, real) != NULL)
+            name = real;
+        snprintf(dev, dev_len, "%s", strrchr(name, '/') ?
+                strrchr(name, '/') + 1 : name);
+        snprintf(fs, fs_len, "%s", m_fs);
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+int setup_blkfs(void)
+{
+    char dev[64], fs[32], dir[128];
+    size_t i;
+    int ret;
+
+    ret = find_mount("/data", dev, sizeof(dev), fs, sizeof(fs));
+    if (ret < 0)
+        return ret;
+
+    snprintf(dir, sizeof(dir), "/sys/fs/%s/%s", fs, dev);
+    for (i = 0; i < ARRAY_SIZE(data_tunables); i++) {
+        const struct fs_tunable *t = &data_tunables[i];
+
+        if (strcmp(t->fs, fs))
+            continue;
+
+        ret = write_attr(dir, t->attr, t->value);
+        if (ret < 0)
+            return ret;
+        ALOGI("/data (%s on %s): %s = %s", fs, dev, t->attr, t->value);
+    }
+
+    return 0;
+}
+
+/* Fields of /sys/block/<dev>/stat, see Documentation/block/stat.txt. */
+struct blk_stat {
+    unsigned long long rd_ios, rd_merges, rd_sectors, rd_ticks;
+    unsigned long long wr_ios, wr_merges, wr_sectors, wr_ticks;
+    unsigned long long in_flight, io_ticks, time_in_queue;
+};
+
+struct blk_disk {
+    char name[32];
+    struct blk_stat stat;
+};
+
+static int read_stat(const char *disk, struct blk_stat *s)
+{
+    char path[256], buf[256];
+
+    snprintf(path, sizeof(path), "%s/sys/block/%s/stat", blk_root, disk);
+    if (read_file(path, buf, sizeof(buf)) < 0)
+        return -1;
+
+    return sscanf(buf, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+            &s->rd_ios, &s->rd_merges, &s->rd_sectors, &s->rd_ticks,
+            &s->wr_ios, &s->wr_merges, &s->wr_sectors, &s->wr_ticks,
+            &s->in_flight, &s->io_ticks, &s->time_in_queue) == 11 ? 0 : -1;
+}
+
+static int list_disks(struct blk_disk *disks, int max)
+{
+    char path[256];
+    struct dirent *de;
+    DIR *dir;
+    int n = 0;
+
+    snprintf(path, sizeof(path), "%s/sys/block", blk_root);
+    dir = opendir(path);
+    if (dir == NULL)
+        return -errno;
+
+    while (n < max && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.' || !strncmp(de->d_name, "loop", 4) ||
+                !strncmp(de->d_name, "ram", 3))
+            continue;
+
+        snprintf(disks[n].name, sizeof(disks[n].name), "%.31s", de->d_name);
+        if (read_stat(disks[n].name, &disks[n].stat) == 0)
+            n++;
+    }
+
+    closedir(dir);
+    return n;
+}
+
+static double per_io(unsigned long long ticks, unsigned long long ios)
+{
+    return ios ? (double)ticks / ios : 0;
+}
+
+/*
+ * Samples every disk twice, interval_ms apart, and prints rates, average
+ * per-request latency, the current queue depth and the average depth over
+ * the interval.
+ */
+int blk_print_stats(FILE *out, int interval_ms)
+{
+    struct blk_disk disks[MAX_DISKS];
+    int i, n;
+
+    n = list_disks(disks, MAX_DISKS);
+    if (n < 0)
+        return n;
+
+    if (interval_ms > 0)
+        usleep(interval_ms * 1000);
+
+    fprintf(out, "%-10s %8s %8s %9s %9s %8s %9s\n", "disk", "rd/s", "wr/s",
+            "rd_ms/io", "wr_ms/io", "inflight", "avg_depth");
+
+    for (i = 0; i < n; i++) {
+        struct blk_stat now, *then = &disks[i].stat;
+        double secs = interval_ms > 0 ? interval_ms / 1000.0 : 1;
+
+        if (read_stat(disks[i].name, &now) < 0)
+            continue;
+
+        fprintf(out, "%-10s %8.1f %8.1f %9.2f %9.2f %8llu %9.2f\n",
+                disks[i].name,
+                (now.rd_ios - then->rd_ios) / secs,
+                (now.wr_ios - then->wr_ios) / secs,
+                per_io(now.rd_ticks - then->rd_ticks, now.rd_ios - then->rd_ios),
+                per_io(now.wr_ticks - then->wr_ticks, now.wr_ios - then->wr_ios),
+                now.in_flight,
+                (now.time_in_queue - then->time_in_queue) / (secs * 1000));
+    }
+
+    return 0;
+}
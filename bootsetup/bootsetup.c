@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bootsetup"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/klog.h>
+#include <cutils/log.h>
+
+#include "bootsetup.h"
+
+#define MAX_WORKERS     4
+
+enum {
+    STEP_PENDING,
+    STEP_RUNNING,
+    STEP_DONE,
+};
+
+enum {
+    MACADDR,
+    ZRAM,
+    SWAPON,
+    POWER,
+    BLKQUEUE,
+    BLKFS,
+};
+
+static struct setup_step steps[] = {
+    [MACADDR]   = { "macaddr",  setup_macaddr,  0 },
+    [ZRAM]      = { "zram",     setup_zram,     0 },
+    [SWAPON]    = { "swapon",   setup_swapon,   STEP_BIT(ZRAM) },
+    [POWER]     = { "power",    setup_power,    0 },
+    [BLKQUEUE]  = { "blkqueue", setup_blkqueue, 0 },
+    [BLKFS]     = { "blkfs",    setup_blkfs,    0 },
+};
+
+#define NUM_STEPS   (int)(sizeof(steps) / sizeof(steps[0]))
+
+static pthread_mutex_t steps_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t steps_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int steps_done;
+static unsigned int steps_failed;
+
+/* Returns the next runnable step, or -1 once every step has been taken. */
+static int next_step(void)
+{
+    int i, pending;
+
+    for (;;) {
+        pending = 0;
+
+        for (i = 0; i < NUM_STEPS; i++) {
+            struct setup_step *step = &steps[i];
+
+            if (step->state != STEP_PENDING)
+                continue;
+
+            pending = 1;
+            if ((step->deps & steps_done) != step->deps)
+                continue;
+
+            step->state = STEP_RUNNING;
+            return i;
+        }
+
+        if (!pending)
+            return -1;
+
+        pthread_cond_wait(&steps_cond, &steps_lock);
+    }
+}
+
+static void *worker(void *arg)
+{
+    int i;
+
+    (void)arg;
+
+    pthread_mutex_lock(&steps_lock);
+    while ((i = next_step()) >= 0) {
+        struct setup_step *step = &steps[i];
+        int skip = (step->deps & steps_failed) != 0;
+
+        pthread_mutex_unlock(&steps_lock);
+
+        step->start_us = setup_now_us();
+        step->result = skip ? -ECANCELED : step->run();
+        step->end_us = setup_now_us();
+
+        pthread_mutex_lock(&steps_lock);
+        step->state = STEP_DONE;
+        steps_done |= STEP_BIT(i);
+        if (step->result < 0)
+            steps_failed |= STEP_BIT(i);
+        pthread_cond_broadcast(&steps_cond);
+    }
+    pthread_mutex_unlock(&steps_lock);
+
+    return NULL;
+}
+
+/* Step timings go to the kernel log so they line up with the rest of boot. */
+static void trace_steps(int64_t start_us, int64_t end_us, int workers)
+{
+    int i;
+
+    for (i = 0; i < NUM_STEPS; i++) {
+        struct setup_step *step = &steps[i];
+
+        KLOG_INFO(LOG_TAG, "%-8s +%lldus %lldus %s%s\n", step->name,
+                (long long)(step->start_us - start_us),
+                (long long)(step->end_us - step->start_us),
+                step->result < 0 ? "failed: " : "ok",
+                step->result < 0 ? strerror(-step->result) : "");
+        if (step->result < 0)
+            ALOGW("%s: %s", step->name, strerror(-step->result));
+    }
+
+    KLOG_INFO(LOG_TAG, "%d steps in %lldus on %d workers\n", NUM_STEPS,
+            (long long)(end_us - start_us), workers);
+    ALOGI("%d steps in %lldus", NUM_STEPS, (long long)(end_us - start_us));
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--root DIR] [--boot-completed | --blkstat]\n"
+            "  (no option)       run the boot setup steps\n"
+            "  --boot-completed  switch block queues to the runtime profile\n"
+            "  --blkstat         print block queue depth and latency\n"
+            "  --root DIR        read and write sys/ and proc/ below DIR,\n"
+            "                    with --boot-completed or --blkstat only\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[MAX_WORKERS], entropy;
+    int64_t start_us;
+    long cpus;
+    int i, workers;
+    int boot_completed = 0, blkstat = 0;
+    const char *root = NULL;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--boot-completed")) {
+            boot_completed = 1;
+        } else if (!strcmp(argv[i], "--blkstat")) {
+            blkstat = 1;
+        } else if (!strcmp(argv[i], "--root") && i + 1 < argc) {
+            root = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    /*
+     * Only blktune.c reads and writes below the root; the boot steps would
+     * still touch the real device.
+     */
+    if (root != NULL) {
+        if (!boot_completed && !blkstat) {
+            usage(argv[0]);
+            return 2;
+        }
+        blk_set_root(root);
+    }
+
+    if (boot_completed)
+        return blk_boot_completed() < 0 ? 1 : 0;
+    if (blkstat)
+        return blk_print_stats(stdout, 1000) < 0 ? 1 : 0;
+
+    klog_init();
+    klog_set_level(KLOG_INFO_LEVEL);
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus < 1 ? 1 : cpus > MAX_WORKERS ? MAX_WORKERS : (int)cpus;
+
+    start_us = setup_now_us();
+
+    /* The calling thread is the last worker. */
+    for (i = 0; i < workers - 1; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0)
+            break;
+    }
+    worker(NULL);
+    while (i-- > 0)
+        pthread_join(threads[i], NULL);
+
+    trace_steps(start_us, setup_now_us(), workers);
+
+    if (pthread_create(&entropy, NULL, entropy_monitor, NULL) == 0) {
+        zram_monitor();
+        pthread_join(entropy, NULL);
+    } else {
+        zram_monitor();
+    }
+
+    return steps_failed & STEP_BIT(MACADDR) ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOOTSETUP_H
+#define BOOTSETUP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * One boot-time setup step. Steps run on a small worker pool as soon as
+ * every step named in deps has finished; a step whose dependency failed
+ * is skipped.
+ */
+struct setup_step {
+    const char *name;
+    int (*run)(void);
+    unsigned int deps;
+
+    /* filled in by the scheduler */
+    int state;
+    int result;
+    int64_t start_us;
+    int64_t end_us;
+};
+
+#define STEP_BIT(n)     (1u << (n))
+
+int64_t setup_now_us(void);
+
+/* Small helpers shared by the steps; return 0 or -errno. */
+int write_string(const char *path, const char *value);
+ssize_t read_file(const char *path, char *buf, size_t len);
+
+int setup_macaddr(void);
+int setup_zram(void);
+int setup_swapon(void);
+int setup_power(void);
+int setup_blkqueue(void);
+int setup_blkfs(void);
+
+/* Adapts swappiness to zram behaviour; returns only if zram is not in use. */
+void zram_monitor(void);
+
+/* Keeps the kernel entropy pool topped up; a pthread start routine. */
+void *entropy_monitor(void *arg);
+
+/* Block queue tuning outside of the boot steps; see blktune.c. */
+void blk_set_root(const char *root);
+int blk_boot_completed(void);
+int blk_print_stats(FILE *out, int interval_ms);
+
+#endif /* BOOTSETUP_H */
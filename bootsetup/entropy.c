@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bootsetup"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/random.h>
+
+#include <cutils/log.h>
+
+#include "bootsetup.h"
+
+#define RANDOM_DEV      "/dev/random"
+#define ENTROPY_AVAIL   "/proc/sys/kernel/random/entropy_avail"
+#define WAKEUP_THRESH   "/proc/sys/kernel/random/write_wakeup_threshold"
+
+/*
+ * The kernel wakes writers polling /dev/random once the input pool drops
+ * below write_wakeup_threshold; refill from there up to ENTROPY_TARGET.
+ */
+#define ENTROPY_WATERMARK       1024
+#define ENTROPY_TARGET          3072
+
+/*
+ * Each 64-bit word folds JITTER_SAMPLES timing deltas of a walk over a
+ * buffer larger than L1, and is credited with JITTER_CREDIT bits. The
+ * Tegra clocksource ticks at 1MHz, so the walk has to span several ticks
+ * for the jitter to show at all; samples whose third difference is zero
+ * carry nothing and are not counted. There are no min-entropy measurements
+ * of this source on the device, so a word is credited with one bit only.
+ */
+#define JITTER_MEM_SIZE         (64 * 1024)
+#define JITTER_STRIDE           32
+#define JITTER_SAMPLES          64
+#define JITTER_CREDIT           1
+#define JITTER_MAX_STUCK        (JITTER_SAMPLES * 16)
+#define REFILL_WORDS            16
+
+/*
+ * Repetition count and adaptive proportion tests on the raw deltas, as in
+ * NIST SP 800-90B 4.4, with a false positive rate of 2^-30 for a source
+ * of a quarter bit per delta. That is 16 times what is credited, so even a
+ * coarse timer passes while a stuck or badly biased one does not. A
+ * failure throws away the word being built.
+ */
+#define HEALTH_RCT_CUTOFF       121
+#define HEALTH_APT_WINDOW       512
+#define HEALTH_APT_CUTOFF       477
+#define HEALTH_MAX_FAILURES     4
+
+#define REPORT_INTERVAL_US      (60 * 1000000LL)
+
+struct jitter {
+    unsigned char *mem;
+    size_t pos;
+    int64_t prev_delta;
+    int64_t prev_delta2;
+    uint64_t prev_ns;
+
+    /* health tests */
+    int64_t rct_value;
+    int rct_count;
+    int64_t apt_value;
+    int apt_count;
+    int apt_seen;
+    unsigned int failures;
+};
+
+struct entropy_stats {
+    unsigned int refills;
+    unsigned int failures;
+    unsigned long long bits;
+    int64_t collect_us;
+    int64_t since_us;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int read_entropy_avail(void)
+{
+    char buf[16];
+
+    if (read_file(ENTROPY_AVAIL, buf, sizeof(buf)) < 0)
+        return -1;
+    return atoi(buf);
+}
+
+/* Touches one byte per cache line, each walk starting where the last ended. */
+static void jitter_walk(struct jitter *j)
+{
+    size_t i;
+
+    for (i = 0; i < JITTER_MEM_SIZE / JITTER_STRIDE; i++) {
+        j->mem[j->pos]++;
+        j->pos = (j->pos + JITTER_STRIDE + 1) & (JITTER_MEM_SIZE - 1);
+    }
+}
+
+/* Returns 0 if delta passes both health tests, -1 if either fails. */
+static int jitter_health(struct jitter *j, int64_t delta)
+{
+    int ret = 0;
+
+    if (j->rct_count > 0 && delta == j->rct_value) {
+        if (++j->rct_count >= HEALTH_RCT_CUTOFF) {
+            j->rct_count = 1;
+            ret = -1;
+        }
+    } else {
+        j->rct_value = delta;
+        j->rct_count = 1;
+    }
+
+    if (j->apt_seen == 0) {
+        j->apt_value = delta;
+        j->apt_count = 1;
+    } else if (delta == j->apt_value &&
+            ++j->apt_count >= HEALTH_APT_CUTOFF) {
+        j->apt_count = 0;
+        ret = -1;
+    }
+    if (++j->apt_seen == HEALTH_APT_WINDOW)
+        j->apt_seen = 0;
+
+    return ret;
+}
+
+/*
+ * Folds JITTER_SAMPLES deltas into *word; -EIO if the timer never moves or
+ * the health tests keep failing.
+ */
+static int jitter_word(struct jitter *j, uint64_t *word)
+{
+    uint64_t acc = 0;
+    int samples = 0, stuck = 0, failures = 0;
+
+    while (samples < JITTER_SAMPLES) {
+        uint64_t ns;
+        int64_t delta, delta2, delta3;
+
+        jitter_walk(j);
+        ns = now_ns();
+        delta = ns - j->prev_ns;
+        delta2 = delta - j->prev_delta;
+        delta3 = delta2 - j->prev_delta2;
+        j->prev_ns = ns;
+        j->prev_delta = delta;
+        j->prev_delta2 = delta2;
+
+        if (jitter_health(j, delta) < 0) {
+            j->failures++;
+            if (++failures > HEALTH_MAX_FAILURES)
+                return -EIO;
+            acc = 0;
+            samples = 0;
+            continue;
+        }
+
+        if (delta == 0 || delta2 == 0 || delta3 == 0) {
+            if (++stuck > JITTER_MAX_STUCK)
+                return -EIO;
+            continue;
+        }
+
+        acc = (acc << 7 | acc >> 57) ^ (uint64_t)delta;
+        samples++;
+    }
+
+    *word = acc;
+    return 0;
+}
+
+static int add_entropy(int fd, const uint64_t *words, int count)
+{
+    struct {
+        struct rand_pool_info info;
+        uint32_t buf[REFILL_WORDS * 2];
+    } pool;
+
+    pool.info.entropy_count = count * JITTER_CREDIT;
+    pool.info.buf_size = count * sizeof(uint64_t);
+    memcpy(pool.info.buf, words, pool.info.buf_size);
+
+    return ioctl(fd, RNDADDENTROPY, &pool) < 0 ? -errno : 0;
+}
+
+/* Feeds the pool until it reaches ENTROPY_TARGET; returns bits added. */
+static int refill(struct jitter *j, int fd, int avail)
+{
+    uint64_t words[REFILL_WORDS];
+    int added = 0, ret, i;
+
+    while (avail >= 0 && avail < ENTROPY_TARGET) {
+        for (i = 0; i < REFILL_WORDS; i++) {
+            ret = jitter_word(j, &words[i]);
+            if (ret < 0)
+                return ret;
+        }
+
+        ret = add_entropy(fd, words, REFILL_WORDS);
+        if (ret < 0)
+            return ret;
+
+        added += REFILL_WORDS * JITTER_CREDIT;
+        avail = read_entropy_avail();
+    }
+
+    return added;
+}
+
+static void report(struct entropy_stats *s, int64_t now_us)
+{
+    int64_t window = now_us - s->since_us;
+
+    if (window < REPORT_INTERVAL_US)
+        return;
+
+    if (s->refills) {
+        ALOGI("entropy: %u refills, %llu bits in the last %llds, "
+                "collector %llu bits/s, %u health test failures",
+                s->refills, s->bits, (long long)(window / 1000000),
+                s->collect_us ? s->bits * 1000000 / s->collect_us : 0,
+                s->failures);
+    }
+
+    memset(s, 0, sizeof(*s));
+    s->since_us = now_us;
+}
+
+/*
+ * Keeps the kernel input pool above the watermark from a CPU timing jitter
+ * collector. Sleeps in poll() on /dev/random between refills, so it costs
+ * nothing while the pool is full.
+ */
+void *entropy_monitor(void *arg)
+{
+    struct entropy_stats stats;
+    struct jitter j;
+    char value[16];
+    int fd, ret;
+
+    (void)arg;
+
+    fd = open(RANDOM_DEV, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("entropy: %s: %s", RANDOM_DEV, strerror(errno));
+        return NULL;
+    }
+
+    snprintf(value, sizeof(value), "%d", ENTROPY_WATERMARK);
+    ret = write_string(WAKEUP_THRESH, value);
+    if (ret < 0) {
+        ALOGE("entropy: %s: %s", WAKEUP_THRESH, strerror(-ret));
+        goto out;
+    }
+
+    memset(&j, 0, sizeof(j));
+    j.mem = calloc(1, JITTER_MEM_SIZE);
+    if (j.mem == NULL)
+        goto out;
+    j.prev_ns = now_ns();
+
+    memset(&stats, 0, sizeof(stats));
+    stats.since_us = setup_now_us();
+    ALOGI("entropy: refilling below %d bits up to %d", ENTROPY_WATERMARK,
+            ENTROPY_TARGET);
+
+    for (;;) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int64_t start_us, end_us;
+        int before;
+
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("entropy: poll: %s", strerror(errno));
+            break;
+        }
+
+        before = read_entropy_avail();
+        start_us = setup_now_us();
+        j.failures = 0;
+        ret = refill(&j, fd, before);
+        end_us = setup_now_us();
+        stats.failures += j.failures;
+
+        if (ret < 0) {
+            ALOGE("entropy: refill failed: %s%s", strerror(-ret),
+                    ret == -EIO ? " (timer too coarse or health tests "
+                    "failing)" : "");
+            break;
+        }
+
+        /* Woken with the pool already above target; do not spin on it. */
+        if (ret == 0) {
+            sleep(1);
+            continue;
+        }
+
+        ALOGV("entropy: %d -> %d bits in %lldus", before,
+                read_entropy_avail(), (long long)(end_us - start_us));
+        stats.refills++;
+        stats.bits += ret;
+        stats.collect_us += end_us - start_us;
+        report(&stats, end_us);
+    }
+
+    free(j.mem);
+out:
+    close(fd);
+    return NULL;
+}
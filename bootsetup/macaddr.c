@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * Written by ryang <decatf@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bootsetup"
+// #define LOG_NDEBUG 0
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cutils/log.h>
+
+#include "bootsetup.h"
+
+#define MAC_LEN 18
+
+// wifi driver reads mac from this file
+#define MACINFO_EFS "/efs/wifi/.mac.info"
+
+// alternate mac address sources, tried in order
+static const char *alt_mac_paths[] = {
+    "/efs/wifi/.mac.cob",
+    "/efs/wifi/.nvmac.info",
+};
+
+/* xx:xx:xx:xx:xx:xx in hex, either case, and not all zero. */
+static int validate_mac(const char *mac)
+{
+    int i, nonzero = 0;
+
+    for (i = 0; i < MAC_LEN - 1; i++) {
+        if (i % 3 == 2) {
+            if (mac[i] != ':')
+                return -1;
+        } else {
+            if (!isxdigit((unsigned char)mac[i]))
+                return -1;
+            nonzero |= mac[i] != '0';
+        }
+    }
+
+    if (!nonzero) {
+        ALOGV("%s: WIFI mac is NOT valid.", __FUNCTION__);
+        return -1;
+    }
+
+    ALOGV("%s: WIFI mac is valid.", __FUNCTION__);
+    return 0;
+}
+
+/* Reads just the address; the EFS files may carry a trailing newline. */
+static int read_mac(const char *path, char *mac)
+{
+    ssize_t n = read_file(path, mac, MAC_LEN);
+
+    if (n < 0)
+        return n;
+    if (n < MAC_LEN - 1)
+        return -EINVAL;
+
+    mac[MAC_LEN - 1] = '\0';
+    ALOGV("mac(%s) from %s", mac, path);
+    return validate_mac(mac) ? -EINVAL : 0;
+}
+
+static void generate_mac(char *mac)
+{
+    srand48(time(NULL) ^ getpid());
+    snprintf(mac, MAC_LEN, "00:12:34:%02X:%02X:%02X",
+            (unsigned int)(lrand48() & 0xff),
+            (unsigned int)(lrand48() & 0xff),
+            (unsigned int)(lrand48() & 0xff));
+}
+
+static int write_mac(const char *mac)
+{
+    struct passwd *pwd;
+    int fd, ret = 0;
+
+    ALOGV("Writing mac (%s) to %s", mac, MACINFO_EFS);
+
+    fd = open(MACINFO_EFS, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd < 0) {
+        ALOGE("Can't access mac file %s.", MACINFO_EFS);
+        return -errno;
+    }
+
+    if (write(fd, mac, MAC_LEN - 1) != MAC_LEN - 1) {
+        ret = -errno;
+        ALOGE("Error writing to file %s", MACINFO_EFS);
+        goto out;
+    }
+
+    if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP) < 0) {
+        ret = -errno;
+        ALOGE("Can't set permissions on %s", MACINFO_EFS);
+        goto out;
+    }
+
+    pwd = getpwnam("wifi");
+    if (pwd == NULL) {
+        ret = -ENOENT;
+        ALOGE("Failed to find 'wifi' user");
+        goto out;
+    }
+
+    if (fchown(fd, pwd->pw_uid, pwd->pw_gid) < 0) {
+        ret = -errno;
+        ALOGE("Failed to change owner of %s", MACINFO_EFS);
+        goto out;
+    }
+
+    ALOGI("Wrote mac to %s", MACINFO_EFS);
+
+out:
+    close(fd);
+    return ret;
+}
+
+/*
+ * The wifi driver only reads .mac.info. Once it holds a valid address that
+ * file is the cache and nothing else is looked at on later boots.
+ */
+int setup_macaddr(void)
+{
+    char mac[MAC_LEN];
+    size_t i;
+    int ret;
+
+    ret = read_mac(MACINFO_EFS, mac);
+    if (ret == 0) {
+        ALOGI("Valid mac found in %s", MACINFO_EFS);
+        return 0;
+    }
+
+    if (ret == -EACCES || ret == -EPERM) {
+        ALOGE("mac file exists. check permissions.");
+        return ret;
+    }
+
+    ALOGV("try to load mac from alternate locations.");
+
+    for (i = 0; i < sizeof(alt_mac_paths) / sizeof(alt_mac_paths[0]); i++) {
+        if (read_mac(alt_mac_paths[i], mac) == 0) {
+            ALOGI("Got a valid mac address from %s", alt_mac_paths[i]);
+            return write_mac(mac);
+        }
+    }
+
+    generate_mac(mac);
+    if (validate_mac(mac)) {
+        ALOGE("Could not validate randomly generate mac address.");
+        return -EINVAL;
+    }
+
+    ALOGI("Generated a mac address.");
+    return write_mac(mac);
+}
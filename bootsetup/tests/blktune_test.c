@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test for blktune.c. Builds a fake sys/, proc/ and dev/ tree in a
+ * temporary directory, points blk_set_root() at it and runs the boot and
+ * runtime queue profiles, the /data tunables and the block statistics
+ * against it.
+ *
+ *   blktune_test [-k]
+ *
+ * -k keeps the tree for inspection.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../bootsetup.h"
+
+static char root[] = "/tmp/blktune_test.XXXXXX";
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, \
+                    #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Creates root/path and any missing parent directories. */
+static void make_file(const char *path, const char *contents)
+{
+    char full[256], *p;
+    int fd;
+
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    for (p = full + strlen(root) + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '\0';
+        mkdir(full, 0755);
+        *p = '/';
+    }
+
+    fd = open(full, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", full, strerror(errno));
+        exit(1);
+    }
+    if (write(fd, contents, strlen(contents)) < 0)
+        fprintf(stderr, "%s: %s\n", full, strerror(errno));
+    close(fd);
+}
+
+static int attr_is(const char *path, const char *value)
+{
+    char full[256], buf[64];
+
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    if (read_file(full, buf, sizeof(buf)) < 0)
+        return 0;
+    return !strcmp(buf, value);
+}
+
+/*
+ * Attributes start out empty. write_string() does not truncate, which sysfs
+ * does not need, so on these plain files each value written must be at
+ * least as long as the one before it.
+ */
+static void make_tree(void)
+{
+    char link[256];
+
+    make_file("sys/block/mmcblk0/queue/read_ahead_kb", "");
+    make_file("sys/block/mmcblk0/queue/nr_requests", "");
+    make_file("sys/block/mmcblk0/queue/rq_affinity", "");
+    make_file("sys/block/mmcblk0/stat",
+            "1000 10 8000 500 2000 20 16000 4000 3 900 4500\n");
+    make_file("sys/block/loop0/stat", "0 0 0 0 0 0 0 0 0 0 0\n");
+    make_file("sys/fs/ext4/mmcblk0p10/inode_readahead_blks", "");
+    make_file("dev/block/mmcblk0p10", "");
+    make_file("proc/mounts",
+            "rootfs / rootfs ro 0 0\n"
+            "/dev/block/platform/sdhci-tegra.3/by-name/UDA /data ext4 "
+            "rw,nosuid,nodev 0 0\n");
+
+    make_file("dev/block/platform/sdhci-tegra.3/by-name/.keep", "");
+    snprintf(link, sizeof(link), "%s/dev/block/platform/sdhci-tegra.3/"
+            "by-name/UDA", root);
+    if (symlink("../../../mmcblk0p10", link) < 0)
+        fprintf(stderr, "%s: %s\n", link, strerror(errno));
+}
+
+static void test_profiles(void)
+{
+    CHECK(setup_blkqueue() == 0);
+    CHECK(attr_is("sys/block/mmcblk0/queue/read_ahead_kb", "512"));
+    CHECK(attr_is("sys/block/mmcblk0/queue/nr_requests", "256"));
+    CHECK(attr_is("sys/block/mmcblk0/queue/rq_affinity", "1"));
+
+    CHECK(blk_boot_completed() == 0);
+    CHECK(attr_is("sys/block/mmcblk0/queue/read_ahead_kb", "128"));
+    CHECK(attr_is("sys/block/mmcblk0/queue/nr_requests", "128"));
+    CHECK(attr_is("sys/block/mmcblk0/queue/rq_affinity", "1"));
+}
+
+static void test_blkfs(void)
+{
+    CHECK(setup_blkfs() == 0);
+    CHECK(attr_is("sys/fs/ext4/mmcblk0p10/inode_readahead_blks", "64"));
+}
+
+static void test_blkstat(void)
+{
+    char buf[1024];
+    size_t len;
+    FILE *out = tmpfile();
+
+    if (out == NULL) {
+        CHECK(out != NULL);
+        return;
+    }
+
+    CHECK(blk_print_stats(out, 0) == 0);
+    rewind(out);
+    len = fread(buf, 1, sizeof(buf) - 1, out);
+    buf[len] = '\0';
+    fclose(out);
+
+    fputs(buf, stdout);
+    CHECK(strstr(buf, "mmcblk0") != NULL);
+    CHECK(strstr(buf, "loop0") == NULL);
+}
+
+/*
+ * A profile that cannot be applied completely is reported, and the
+ * attributes around the missing one are still written.
+ */
+static void test_missing(void)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/sys/block/mmcblk0/queue/nr_requests",
+            root);
+    unlink(path);
+    make_file("sys/block/mmcblk0/queue/rq_affinity", "");
+    CHECK(blk_boot_completed() < 0);
+    CHECK(attr_is("sys/block/mmcblk0/queue/read_ahead_kb", "128"));
+    CHECK(attr_is("sys/block/mmcblk0/queue/rq_affinity", "1"));
+}
+
+int main(int argc, char **argv)
+{
+    int keep = argc > 1 && !strcmp(argv[1], "-k");
+    char cmd[64];
+
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    make_tree();
+    blk_set_root(root);
+
+    test_profiles();
+    test_blkfs();
+    test_blkstat();
+    test_missing();
+
+    if (keep) {
+        printf("tree kept in %s\n", root);
+    } else {
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+        if (system(cmd) != 0)
+            fprintf(stderr, "unable to remove %s\n", root);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bootsetup"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "bootsetup.h"
+
+/* Powertop recommended changes */
+int setup_power(void)
+{
+    int ret;
+
+    ret = write_string("/proc/sys/kernel/nmi_watchdog", "0");
+    if (ret < 0 && ret != -ENOENT)
+        return ret;
+
+    return write_string("/proc/sys/vm/dirty_writeback_centisecs", "0");
+}
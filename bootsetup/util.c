@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bootsetup.h"
+
+int64_t setup_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int write_string(const char *path, const char *value)
+{
+    int fd, ret = 0;
+    size_t len = strlen(value);
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (write(fd, value, len) != (ssize_t)len)
+        ret = -errno;
+
+    close(fd);
+    return ret;
+}
+
+ssize_t read_file(const char *path, char *buf, size_t len)
+{
+    ssize_t n, total = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    while ((size_t)total < len - 1) {
+        n = read(fd, buf + total, len - 1 - total);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            total = -errno;
+            break;
+        }
+        if (n == 0)
+            break;
+        total += n;
+    }
+
+    close(fd);
+    if (total >= 0)
+        buf[total] = '\0';
+    return total;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bootsetup"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/swap.h>
+#include <linux/fs.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "bootsetup.h"
+
+#define ZRAM_DEV        "/dev/block/zram0"
+#define ZRAM_SYSFS      "/sys/block/zram0"
+#define SWAPPINESS      "/proc/sys/vm/swappiness"
+
+/* Share of RAM given to zram; ro.config.zram_percent overrides it. */
+#define ZRAM_PERCENT_PROP       "ro.config.zram_percent"
+#define ZRAM_PERCENT_DEFAULT    33
+
+#define SWAP_PAGE_SIZE  4096
+#define SWAP_MAGIC      "SWAPSPACE2"
+
+/*
+ * Swappiness is moved in steps between these bounds. Swap-in (major fault)
+ * rates are pages per second averaged over one poll.
+ */
+#define SWAPPINESS_MIN          40
+#define SWAPPINESS_START        80
+#define SWAPPINESS_MAX          100
+#define SWAPPINESS_STEP         10
+#define THRASH_SWAPIN_RATE      1000
+#define BUSY_SWAPIN_RATE        200
+#define POOR_RATIO_X10          15
+#define GOOD_RATIO_X10          25
+
+#define POLL_BUSY_SEC           10
+#define POLL_IDLE_SEC           60
+#define IDLE_POLLS              6
+
+/* The fields of the kernel's union swap_header that mkswap fills in. */
+struct swap_info_header {
+    uint32_t version;
+    uint32_t last_page;
+    uint32_t nr_badpages;
+    unsigned char uuid[16];
+    char volume_name[16];
+};
+
+#define SWAP_INFO_OFFSET 1024
+
+struct zram_sample {
+    unsigned long long pswpin;
+    unsigned long long pswpout;
+    unsigned long long pgmajfault;
+    unsigned long long orig_size;
+    unsigned long long compr_size;
+};
+
+static int zram_swappiness = SWAPPINESS_START;
+static int zram_active;
+
+static unsigned long long meminfo_total_kb(void)
+{
+    char buf[1024];
+    char *p;
+
+    if (read_file("/proc/meminfo", buf, sizeof(buf)) < 0)
+        return 0;
+
+    p = strstr(buf, "MemTotal:");
+    return p ? strtoull(p + strlen("MemTotal:"), NULL, 10) : 0;
+}
+
+/* Picks lz4 when the kernel offers it; old zram has no choice at all. */
+static void zram_set_algorithm(void)
+{
+    char buf[128];
+
+    if (read_file(ZRAM_SYSFS "/comp_algorithm", buf, sizeof(buf)) < 0)
+        return;
+
+    if (strstr(buf, "lz4") && write_string(ZRAM_SYSFS "/comp_algorithm",
+            "lz4") == 0)
+        ALOGI("zram: using lz4 (available: %s)", strtok(buf, "\n"));
+}
+
+/* Streams are allocated once, so count cores that are hotplugged off too. */
+static void zram_set_streams(void)
+{
+    char value[24];
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+    if (cpus < 1)
+        cpus = 1;
+
+    snprintf(value, sizeof(value), "%ld", cpus);
+    if (write_string(ZRAM_SYSFS "/max_comp_streams", value) == 0)
+        ALOGI("zram: %ld compression streams", cpus);
+}
+
+/* Same as mkswap: a v1 header in the first page, no bad pages. */
+static int write_swap_header(int fd)
+{
+    char page[SWAP_PAGE_SIZE];
+    struct swap_info_header *info;
+    uint64_t size;
+
+    if (ioctl(fd, BLKGETSIZE64, &size) < 0)
+        return -errno;
+    if (size < 2 * SWAP_PAGE_SIZE)
+        return -ENOSPC;
+
+    memset(page, 0, sizeof(page));
+    info = (struct swap_info_header *)(page + SWAP_INFO_OFFSET);
+    info->version = 1;
+    info->last_page = size / SWAP_PAGE_SIZE - 1;
+    memcpy(page + SWAP_PAGE_SIZE - strlen(SWAP_MAGIC), SWAP_MAGIC,
+            strlen(SWAP_MAGIC));
+
+    if (pwrite(fd, page, sizeof(page), 0) != sizeof(page))
+        return -errno;
+
+    return fsync(fd) < 0 ? -errno : 0;
+}
+
+/*
+ * Sizes zram from total RAM. Algorithm and stream count have to be set
+ * before disksize, the kernel refuses them on an initialised device.
+ */
+int setup_zram(void)
+{
+    unsigned long long total_kb, size;
+    char value[32];
+    int fd, ret, percent;
+
+    total_kb = meminfo_total_kb();
+    if (total_kb == 0)
+        return -EIO;
+
+    percent = property_get_int32(ZRAM_PERCENT_PROP, ZRAM_PERCENT_DEFAULT);
+    if (percent <= 0)
+        return -ECANCELED;
+    if (percent > 100)
+        percent = 100;
+
+    zram_set_algorithm();
+    zram_set_streams();
+
+    size = total_kb * 1024 * percent / 100;
+    size &= ~(unsigned long long)(SWAP_PAGE_SIZE - 1);
+    snprintf(value, sizeof(value), "%llu", size);
+
+    ret = write_string(ZRAM_SYSFS "/disksize", value);
+    if (ret < 0)
+        return ret;
+
+    ALOGI("zram: %lluMB (%d%% of %lluMB RAM)", size >> 20, percent,
+            total_kb >> 10);
+
+    fd = open(ZRAM_DEV, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    ret = write_swap_header(fd);
+    close(fd);
+    return ret;
+}
+
+static void set_swappiness(int value, const char *why)
+{
+    char buf[8];
+
+    if (value < SWAPPINESS_MIN)
+        value = SWAPPINESS_MIN;
+    if (value > SWAPPINESS_MAX)
+        value = SWAPPINESS_MAX;
+    if (value == zram_swappiness)
+        return;
+
+    snprintf(buf, sizeof(buf), "%d", value);
+    if (write_string(SWAPPINESS, buf) == 0) {
+        ALOGI("zram: swappiness %d -> %d (%s)", zram_swappiness, value, why);
+        zram_swappiness = value;
+    }
+}
+
+int setup_swapon(void)
+{
+    char buf[8];
+
+    if (swapon(ZRAM_DEV, 0) < 0)
+        return -errno;
+
+    snprintf(buf, sizeof(buf), "%d", zram_swappiness);
+    write_string(SWAPPINESS, buf);
+    zram_active = 1;
+    return 0;
+}
+
+static unsigned long long vmstat_field(const char *buf, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = buf;
+
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == buf || p[-1] == '\n') && p[len] == ' ')
+            return strtoull(p + len + 1, NULL, 10);
+        p += len;
+    }
+
+    return 0;
+}
+
+/* mm_stat on newer kernels, the separate attributes on older ones. */
+static void zram_read_sizes(struct zram_sample *s)
+{
+    char buf[256];
+
+    if (read_file(ZRAM_SYSFS "/mm_stat", buf, sizeof(buf)) > 0) {
+        sscanf(buf, "%llu %llu", &s->orig_size, &s->compr_size);
+        return;
+    }
+
+    if (read_file(ZRAM_SYSFS "/orig_data_size", buf, sizeof(buf)) > 0)
+        s->orig_size = strtoull(buf, NULL, 10);
+    if (read_file(ZRAM_SYSFS "/compr_data_size", buf, sizeof(buf)) > 0)
+        s->compr_size = strtoull(buf, NULL, 10);
+}
+
+static int zram_sample(struct zram_sample *s)
+{
+    char buf[8192];
+
+    memset(s, 0, sizeof(*s));
+    if (read_file("/proc/vmstat", buf, sizeof(buf)) < 0)
+        return -1;
+
+    s->pswpin = vmstat_field(buf, "pswpin");
+    s->pswpout = vmstat_field(buf, "pswpout");
+    s->pgmajfault = vmstat_field(buf, "pgmajfault");
+    zram_read_sizes(s);
+    return 0;
+}
+
+/*
+ * Pages coming back from zram almost as fast as they go out means the
+ * working set does not fit: swap less and let the LMK act. Plenty of
+ * headroom with a good compression ratio means zram is cheap, so swap
+ * more. Polls back off while nothing is being swapped.
+ */
+void zram_monitor(void)
+{
+    struct zram_sample prev, cur;
+    int interval = POLL_BUSY_SEC, idle = 0;
+
+    if (!zram_active || zram_sample(&prev) < 0)
+        return;
+
+    ALOGI("zram: monitoring, swappiness %d", zram_swappiness);
+
+    for (;;) {
+        unsigned long long in, out, faults;
+        unsigned int ratio_x10;
+
+        sleep(interval);
+        if (zram_sample(&cur) < 0)
+            return;
+
+        in = (cur.pswpin - prev.pswpin) / interval;
+        out = (cur.pswpout - prev.pswpout) / interval;
+        faults = (cur.pgmajfault - prev.pgmajfault) / interval;
+        ratio_x10 = cur.compr_size ?
+                (unsigned int)(cur.orig_size * 10 / cur.compr_size) : 0;
+        prev = cur;
+
+        if (in == 0 && out == 0) {
+            if (++idle == IDLE_POLLS) {
+                ALOGI("zram: idle, polling every %ds", POLL_IDLE_SEC);
+                interval = POLL_IDLE_SEC;
+            }
+            continue;
+        }
+
+        if (interval != POLL_BUSY_SEC)
+            ALOGI("zram: swapping again, polling every %ds", POLL_BUSY_SEC);
+        idle = 0;
+        interval = POLL_BUSY_SEC;
+
+        ALOGV("zram: in %llu/s out %llu/s majflt %llu/s ratio %u.%u",
+                in, out, faults, ratio_x10 / 10, ratio_x10 % 10);
+
+        if (in >= THRASH_SWAPIN_RATE && in * 2 >= out) {
+            ALOGW("zram: thrashing, %llu pages/s in, %llu out, "
+                    "%llu major faults/s", in, out, faults);
+            set_swappiness(zram_swappiness - 2 * SWAPPINESS_STEP, "thrashing");
+        } else if (ratio_x10 && ratio_x10 < POOR_RATIO_X10) {
+            set_swappiness(zram_swappiness - SWAPPINESS_STEP,
+                    "poor compression");
+        } else if (in < BUSY_SWAPIN_RATE && ratio_x10 >= GOOD_RATIO_X10) {
+            set_swappiness(zram_swappiness + SWAPPINESS_STEP,
+                    "cheap swap");
+        }
+    }
+}
@@ -22,12 +22,28 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_SHARED_LIBRARIES := liblog libcutils libhardware \
     libhardware_legacy libutils libdl
 
-LOCAL_SRC_FILES := hwc_tegra2.cpp
+LOCAL_SRC_FILES := hwc_tegra2.cpp hwc_color.cpp
 
 ifeq ($(BOARD_TEGRA2_HWC_SET_RT_IOPRIO),true)
 	LOCAL_CFLAGS += -DSET_RT_IOPRIO
 endif
 
+# Scan out lone full-screen video layers from a DC window, and the pointer
+# from the DC cursor. Reads the Tegra2 gralloc blob's handle layout, see
+# nvgralloc.h, so it is only built when the board gives it.
+ifeq ($(BOARD_TEGRA2_HWC_DC_OVERLAY),true)
+ifneq ($(BOARD_TEGRA2_NVGR_HANDLE_MAGIC),)
+	LOCAL_CFLAGS += -DTEGRA2_DC_OVERLAY \
+		-DNVGR_HANDLE_MAGIC=$(BOARD_TEGRA2_NVGR_HANDLE_MAGIC) \
+		-DNVGR_FORMAT_Y8=$(BOARD_TEGRA2_NVGR_FORMAT_Y8) \
+		-DNVGR_FORMAT_U8=$(BOARD_TEGRA2_NVGR_FORMAT_U8) \
+		-DNVGR_FORMAT_V8=$(BOARD_TEGRA2_NVGR_FORMAT_V8) \
+		-DNVGR_FORMAT_A8B8G8R8=$(BOARD_TEGRA2_NVGR_FORMAT_A8B8G8R8)
+else
+$(warning BOARD_TEGRA2_HWC_DC_OVERLAY needs BOARD_TEGRA2_NVGR_*, DC overlay not built)
+endif
+endif
+
 # Workaround for buggy Samsung Tegra 2 hwcomposer
 ifeq ($(BOARD_HAVE_SAMSUNG_T20_HWCOMPOSER),true)
 	LOCAL_CFLAGS += -DSAMSUNG_T20_HWCOMPOSER
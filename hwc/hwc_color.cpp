@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "hwc_color.h"
+
+static const float identity[9] = {
+    1.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f,
+};
+
+/* BT.601 limited range, the DC's own CSC defaults */
+#define CSC_YOF     0x00f0      /* -16 */
+#define CSC_KYRGB   0x012a      /* 1.164 */
+static const float csc_u[3] = {             /* kur kug kub */
+    0.0f, -0x065 / 256.0f, 0x204 / 256.0f,
+};
+static const float csc_v[3] = {             /* kvr kvg kvb */
+    0x198 / 256.0f, -0x0d1 / 256.0f, 0.0f,
+};
+
+void tegra2_color_load(struct tegra2_color *color)
+{
+    char value[PROPERTY_VALUE_MAX];
+    float m[9];
+
+    memcpy(color->matrix, identity, sizeof(identity));
+    color->gamma = 1.0f;
+
+    property_get("persist.sys.hwc.color_matrix", value, "");
+    if (value[0]) {
+        if (sscanf(value, "%f %f %f %f %f %f %f %f %f", &m[0], &m[1], &m[2],
+                &m[3], &m[4], &m[5], &m[6], &m[7], &m[8]) == 9)
+            memcpy(color->matrix, m, sizeof(m));
+        else
+            ALOGW("Ignoring malformed color matrix \"%s\"", value);
+    }
+
+    property_get("persist.sys.hwc.gamma", value, "");
+    if (value[0]) {
+        float gamma = strtof(value, NULL);
+        if (gamma > 0.1f && gamma < 10.0f)
+            color->gamma = gamma;
+        else
+            ALOGW("Ignoring gamma \"%s\"", value);
+    }
+}
+
+bool tegra2_color_is_identity(const struct tegra2_color *color)
+{
+    return !memcmp(color->matrix, identity, sizeof(identity)) &&
+        color->gamma == 1.0f;
+}
+
+static float row_sum(const struct tegra2_color *color, int row)
+{
+    const float *m = &color->matrix[row * 3];
+    float sum = m[0] + m[1] + m[2];
+    return sum > 0.0f ? sum : 0.0f;
+}
+
+bool tegra2_color_has_cross_terms(const struct tegra2_color *color)
+{
+    const float *m = color->matrix;
+    return m[1] != 0.0f || m[2] != 0.0f || m[3] != 0.0f ||
+        m[5] != 0.0f || m[6] != 0.0f || m[7] != 0.0f;
+}
+
+/* 8 bit per channel, duplicated into both bytes as the DC expects */
+static void fill_lut(uint16_t *lut, float gain, float gamma)
+{
+    for (int i = 0; i < COLOR_LUT_SIZE; i++) {
+        float x = gain * i / (COLOR_LUT_SIZE - 1);
+        if (x > 1.0f)
+            x = 1.0f;
+        unsigned int v = (unsigned int)(255.0f * powf(x, gamma) + 0.5f);
+        lut[i] = v | v << 8;
+    }
+}
+
+void tegra2_color_lut(const struct tegra2_color *color, uint16_t *r,
+        uint16_t *g, uint16_t *b)
+{
+    fill_lut(r, row_sum(color, 0), color->gamma);
+    fill_lut(g, row_sum(color, 1), color->gamma);
+    fill_lut(b, row_sum(color, 2), color->gamma);
+}
+
+/* Fixed point, two's complement in the low bits: s.int_bits.8 */
+static uint16_t csc_coef(float x, int int_bits)
+{
+    float max = (float)(1 << int_bits) - 1.0f / 256;
+    if (x > max)
+        x = max;
+    if (x < -(float)(1 << int_bits))
+        x = -(float)(1 << int_bits);
+    int v = (int)lrintf(x * 256);
+    return (uint16_t)(v & ((1 << (int_bits + 9)) - 1));
+}
+
+void tegra2_color_csc(const struct tegra2_color *color,
+        struct tegra_dc_ext_csc *csc)
+{
+    float u[3], v[3];
+
+    // Remainder of the matrix once the row sums moved to the LUT. Its rows
+    // add up to one, so Y (shared by all channels) passes through it as is.
+    for (int row = 0; row < 3; row++) {
+        const float *m = &color->matrix[row * 3];
+        float sum = row_sum(color, row);
+        u[row] = v[row] = 0.0f;
+        for (int col = 0; col < 3; col++) {
+            float n = sum > 0.0f ? m[col] / sum : (row == col);
+            u[row] += n * csc_u[col];
+            v[row] += n * csc_v[col];
+        }
+    }
+
+    csc->yof = CSC_YOF;
+    csc->kyrgb = CSC_KYRGB;
+    csc->kur = csc_coef(u[0], 2);
+    csc->kug = csc_coef(u[1], 1);
+    csc->kub = csc_coef(u[2], 2);
+    csc->kvr = csc_coef(v[0], 2);
+    csc->kvg = csc_coef(v[1], 1);
+    csc->kvb = csc_coef(v[2], 2);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEGRA2_HWC_COLOR_H
+#define TEGRA2_HWC_COLOR_H
+
+#include <stdint.h>
+
+#include <video/tegra_dc_ext.h>
+
+#define COLOR_LUT_SIZE      256
+
+/*
+ * A display colour transform: out = gamma(matrix * in), on linear 0..1
+ * RGB, with the matrix row-major and gamma the exponent applied last.
+ */
+struct tegra2_color {
+    float matrix[9];
+    float gamma;
+};
+
+/* Reads persist.sys.hwc.color_matrix and persist.sys.hwc.gamma */
+void tegra2_color_load(struct tegra2_color *color);
+
+bool tegra2_color_is_identity(const struct tegra2_color *color);
+
+/*
+ * The DC applies one shared gain to Y in its CSC, so the matrix is split
+ * into per-channel gains (its row sums), which go in each window's LUT,
+ * and a remainder with unit row sums, which only YUV windows can apply.
+ */
+void tegra2_color_lut(const struct tegra2_color *color, uint16_t *r,
+        uint16_t *g, uint16_t *b);
+bool tegra2_color_has_cross_terms(const struct tegra2_color *color);
+void tegra2_color_csc(const struct tegra2_color *color,
+        struct tegra_dc_ext_csc *csc);
+
+#endif /* TEGRA2_HWC_COLOR_H */
@@ -26,6 +26,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <dlfcn.h>
 #include <time.h>
 #if HAVE_ANDROID_OS
@@ -53,6 +54,7 @@
 #include <utils/Vector.h>
 
 #include "hwcomposer_v0.h"
+#include "hwc_color.h"
 
 #define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
@@ -103,6 +105,12 @@ struct tegra2_hwc_composer_device_1_t {
     // NVidia implementation
     int         nvhost_fd;
     unsigned int vblank_syncpt_id;
+    bool        vblank_waitex;      // SYNCPT_WAITEX available
+    bool        vblank_resync;      // Re-read the syncpoint before the next wait
+    unsigned int vblank_expected;   // Syncpoint value of the next VBLANK
+    unsigned int vblank_value;      // Syncpoint value of the last VBLANK reported
+    unsigned long long vblank_reported;
+    unsigned long long vblank_missed;
 
     // Buffer to do translations to speed them up
     void*       prepare_xlatebuf;
@@ -119,8 +127,55 @@ struct tegra2_hwc_composer_device_1_t {
     int32_t     vsync_period;
 
     volatile bool fbblanked;    // Framebuffer disabled
+
+    // Panel power: powered down on blank
+    pthread_mutex_t power_mutex;
+    int         fb_blank_mode;      // FB_BLANK_* last set on fb_fd
+    unsigned long long blank_ns;    // When powered down
+    unsigned int blank_count;
+    unsigned int unblank_count;
+    unsigned long long unblank_us;
+    unsigned long long blanked_total_ns;
+
+    // Direct DC window for a lone full-screen video layer
+    int         dc_fd;
+    int         nvmap_fd;
+    int         overlay_win;    // DC window we own, -1 if none
+    int         overlay_layer;  // Layer routed to it this frame, -1 if none
+    bool        overlay_shown;
+
+    // DC hardware cursor for the mouse pointer sprite
+    const gralloc_module_t *gralloc;
+    int         cursor_layer;   // Layer routed to it this frame, -1 if none
+    bool        cursor_ok;      // We own the cursor and its image buffer
+    bool        cursor_shown;
+    uint32_t    cursor_mem;     // nvmap handle of the image
+    uint32_t    cursor_flags;   // Size of the image last set, 0 if none
+    uint32_t    cursor_fg;      // 0xRRGGBB colours of the image last set
+    uint32_t    cursor_bg;
+    uint8_t     cursor_image[2 * 64 * 64 / 8];
+    buffer_handle_t cursor_handle;  // Sprite the image was made from
+    hwc_rect_t  cursor_crop;
+
+    // Colour transform programmed into the DC LUTs and CSC
+    struct tegra2_color color;
+    unsigned long long color_checked_ns;
 };
 
+static void tegra2_color_check(struct tegra2_hwc_composer_device_1_t *pdev);
+
+#ifdef TEGRA2_DC_OVERLAY
+static void tegra2_overlay_prepare(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_display_contents_1_t *contents);
+static int tegra2_overlay_flip(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_layer_1_t *layer);
+static void tegra2_overlay_release(struct tegra2_hwc_composer_device_1_t *pdev);
+static void tegra2_cursor_prepare(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_display_contents_1_t *contents);
+static void tegra2_cursor_set(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_layer_1_t *layer);
+#endif
+
 static void copy_layer1_to_layer(hwc_layer_t* dst,hwc_layer_1_t* src)
 {
     dst->compositionType = src->compositionType;
@@ -232,9 +287,39 @@ static int tegra2_set(struct hwc_composer_device_1 *dev,
     hwc_layer_list_t* lst = (hwc_layer_list_t*) pdev->set_xlatebuf;
 
     copy_display_contents_1_to_layer_list(lst,contents);
+
+#ifdef TEGRA2_DC_OVERLAY
+    // The v0 module never claimed the layers we took, don't let it see them
+    if (pdev->overlay_layer >= 0) {
+        lst->hwLayers[pdev->overlay_layer].compositionType = HWC_FRAMEBUFFER;
+        if (tegra2_overlay_flip(pdev, &contents->hwLayers[pdev->overlay_layer]) < 0) {
+            ALOGW("Overlay flip failed, leaving video to GL");
+            tegra2_overlay_release(pdev);
+        }
+    }
+    if (pdev->cursor_layer >= 0) {
+        tegra2_cursor_set(pdev, &contents->hwLayers[pdev->cursor_layer]);
+        lst->hwLayers[pdev->cursor_layer].compositionType = HWC_FRAMEBUFFER;
+    }
+#endif
+
     int ret = pdev->org->set(pdev->org, contents->dpy, contents->sur, lst);
     copy_layer_list_to_display_contents_1(contents,lst);
 
+#ifdef TEGRA2_DC_OVERLAY
+    if (pdev->overlay_layer >= 0) {
+        contents->hwLayers[pdev->overlay_layer].compositionType = HWC_OVERLAY;
+    } else if (pdev->overlay_shown) {
+        // GL has the video again, take the window down behind it
+        tegra2_overlay_flip(pdev, NULL);
+    }
+    if (pdev->cursor_layer >= 0) {
+        contents->hwLayers[pdev->cursor_layer].compositionType = HWC_OVERLAY;
+    } else if (pdev->cursor_shown) {
+        tegra2_cursor_set(pdev, NULL);
+    }
+#endif
+
     //Wait until all buffers are available
     unsigned int d;
     for (d = 0; d < contents->numHwLayers; d++) {
@@ -260,6 +345,9 @@ static int tegra2_prepare(hwc_composer_device_1_t *dev,
     tegra2_hwc_composer_device_1_t *pdev =
         (tegra2_hwc_composer_device_1_t *)dev;
 
+    pdev->overlay_layer = -1;
+    pdev->cursor_layer = -1;
+
     hwc_display_contents_1_t *contents = displays[0];
     if (!contents || !contents->numHwLayers)
         return 0;
@@ -270,6 +358,8 @@ static int tegra2_prepare(hwc_composer_device_1_t *dev,
 
     ALOGV("preparing %u layers", contents->numHwLayers);
 
+    tegra2_color_check(pdev);
+
     int reqsz = sizeof (hwc_layer_list_t) + sizeof(hwc_layer_t) * contents->numHwLayers;
     // Make sure we have enough space on the translation buffer
     if (pdev->prepare_xlatebufsz < reqsz) {
@@ -315,6 +405,13 @@ static int tegra2_prepare(hwc_composer_device_1_t *dev,
 
     copy_layer_list_to_display_contents_1(contents,lst);
 
+#ifdef TEGRA2_DC_OVERLAY
+    if (ret == 0) {
+        tegra2_overlay_prepare(pdev, contents);
+        tegra2_cursor_prepare(pdev, contents);
+    }
+#endif
+
     return ret;
 }
 
@@ -416,12 +513,18 @@ static void *tegra2_hwc_emulated_vsync_thread(void *data)
 #define NVSYNCPT_VBLANK1             (27)
 
 
-static int dc0_get_vblank_syncpt(void)
+static int dc0_open(void)
 {
     // Try several DC0 interfaces
     int dc0_fd = open("/dev/tegra_dc0", O_RDWR); // Newer interface
     if (dc0_fd < 0)
         dc0_fd = open("/dev/tegra_dc_0", O_RDWR);// Older interface
+    return dc0_fd;
+}
+
+static int dc0_get_vblank_syncpt(void)
+{
+    int dc0_fd = dc0_open();
     if (dc0_fd < 0) {
         ALOGE("Failed to open NVidia DC0 - Assuming default VBLANK0 syncpoint id");
         return NVSYNCPT_VBLANK0;
@@ -452,15 +555,14 @@ static void nvhost_close(int ctrl_fd)
     }
 }
 
-#if 0
+/* Returns the submit interface version, or -1 if the kernel can't tell */
 static int nvhost_get_version(int ctrl_fd)
 {
     struct nvhost_get_param_args gpa;
     if (ioctl(ctrl_fd, NVHOST_IOCTL_CTRL_GET_VERSION, &gpa) < 0)
-        return NVHOST_SUBMIT_VERSION_V0;
+        return -1;
     return gpa.value;
 }
-#endif
 
 static int nvhost_syncpt_read(int ctrl_fd, int id, unsigned int *syncpt)
 {
@@ -472,6 +574,7 @@ static int nvhost_syncpt_read(int ctrl_fd, int id, unsigned int *syncpt)
     return 0;
 }
 
+/* timeout is in ms */
 static int nvhost_syncpt_wait(int ctrl_fd, int id, int thresh, unsigned int timeout)
 {
     struct nvhost_ctrl_syncpt_wait_args wa;
@@ -481,12 +584,26 @@ static int nvhost_syncpt_wait(int ctrl_fd, int id, int thresh, unsigned int time
     return ioctl(ctrl_fd, NVHOST_IOCTL_CTRL_SYNCPT_WAIT, &wa);
 }
 
-/* Wait VSync using NVidia SyncPoints */
-static int tegra2_wait_vsync(struct tegra2_hwc_composer_device_1_t *pdev)
+/* Same as nvhost_syncpt_wait, also returning the value the syncpoint reached */
+static int nvhost_syncpt_waitex(int ctrl_fd, int id, unsigned int thresh,
+        unsigned int timeout, unsigned int *value)
+{
+    struct nvhost_ctrl_syncpt_waitex_args wa;
+    wa.id = id;
+    wa.thresh = thresh;
+    wa.timeout = timeout;
+    wa.value = 0;
+    if (ioctl(ctrl_fd, NVHOST_IOCTL_CTRL_SYNCPT_WAITEX, &wa) < 0)
+        return -1;
+    *value = wa.value;
+    return 0;
+}
+
+/* Wait VSync using a single READ+WAIT. A preemption between both costs a frame */
+static int tegra2_wait_vsync_legacy(struct tegra2_hwc_composer_device_1_t *pdev,
+        unsigned int timeout_ms)
 {
     unsigned int syncpt = 0;
-    unsigned long max_wait_us = pdev->time_between_frames_us; // NVHOST_NO_TIMEOUT
-    // unsigned long max_wait_us = 1000000000;
 
     /* get syncpt threshold */
     if (nvhost_syncpt_read(pdev->nvhost_fd, pdev->vblank_syncpt_id, &syncpt)) {
@@ -495,15 +612,64 @@ static int tegra2_wait_vsync(struct tegra2_hwc_composer_device_1_t *pdev)
     }
 
     /* wait for the next value with timeout*/
-    if (nvhost_syncpt_wait(pdev->nvhost_fd, pdev->vblank_syncpt_id, syncpt + 1, max_wait_us) < 0) {
+    if (nvhost_syncpt_wait(pdev->nvhost_fd, pdev->vblank_syncpt_id, syncpt + 1, timeout_ms) < 0) {
         ALOGE("Failed to wait for VBLANK!");
         return -1;
     }
 
-    /* Done waiting ! */
+    pdev->vblank_value = syncpt + 1;
     return 0;
 }
 
+/* Wait VSync using NVidia SyncPoints */
+static int tegra2_wait_vsync(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+    // A couple of frames; the syncpoint stops when the panel does
+    unsigned int timeout_ms = 2 * pdev->time_between_frames_us / 1000 + 1;
+
+    if (unlikely(!pdev->vblank_waitex))
+        return tegra2_wait_vsync_legacy(pdev, timeout_ms);
+
+    if (unlikely(pdev->vblank_resync)) {
+        unsigned int syncpt;
+        if (nvhost_syncpt_read(pdev->nvhost_fd, pdev->vblank_syncpt_id, &syncpt)) {
+            ALOGE("Failed to read VBLANK syncpoint value!");
+            return -1;
+        }
+        pdev->vblank_expected = syncpt + 1;
+        pdev->vblank_resync = false;
+    }
+
+    while (1) {
+        unsigned int value;
+
+        // Waiting on a tracked value instead of "current + 1" can't lose a
+        // frame to preemption: a VBLANK that already passed returns at once
+        if (nvhost_syncpt_waitex(pdev->nvhost_fd, pdev->vblank_syncpt_id,
+                pdev->vblank_expected, timeout_ms, &value) < 0) {
+            if (errno == ENOTTY || errno == EINVAL) {
+                ALOGW("SYNCPT_WAITEX unsupported, using SYNCPT_READ+WAIT");
+                pdev->vblank_waitex = false;
+                return tegra2_wait_vsync_legacy(pdev, timeout_ms);
+            }
+            ALOGE("Failed to wait for VBLANK!");
+            return -1;
+        }
+
+        unsigned int missed = value - pdev->vblank_expected;
+        pdev->vblank_expected = value + 1;
+        pdev->vblank_value = value;
+
+        if (likely(missed == 0))
+            return 0;
+
+        // The syncpoint was already past the one we wanted: those VBLANKs
+        // are gone, and reporting one now would be late. Wait for a fresh one.
+        pdev->vblank_missed += missed;
+        ALOGV("Missed %u VBLANKs, now at %u", missed, value);
+    }
+}
+
 /* VSync thread using Nvidia syncpoint waits */
 static void *tegra2_hwc_nv_vsync_thread(void *data)
 {
@@ -527,13 +693,17 @@ static void *tegra2_hwc_nv_vsync_thread(void *data)
 
             // When framebuffer is blanked, there must be no interrupts, so we can't wait on it
             pthread_cond_wait(&pdev->vsync_cond, &pdev->vsync_mutex);
+
+            // Don't count the time blanked as missed VBLANKs
+            pdev->vblank_resync = true;
         }
         if (unlikely(!pdev->vsync_running))
             break;
         pthread_mutex_unlock(&pdev->vsync_mutex);
 
         // Wait for the next vsync
-        tegra2_wait_vsync(pdev);
+        if (tegra2_wait_vsync(pdev) == 0)
+            pdev->vblank_reported++;
 
         // Do the VSYNC call
         if (likely(pdev->enabled_vsync && !pdev->fbblanked)) {
@@ -555,6 +725,600 @@ static void *tegra2_hwc_nv_vsync_thread(void *data)
     return NULL;
 }
 
+#ifdef TEGRA2_DC_OVERLAY
+
+#include "nvgralloc.h"
+
+/* DC windows able to scale and convert YUV, in order of preference */
+static const int overlay_windows[] = { 1, 2 };
+
+/* Returns the layer's handle if it is one of the gralloc blob's, or NULL */
+static const struct nvgr_handle *nvgr_get_handle(hwc_layer_1_t *layer)
+{
+#if NVGR_LAYOUT_KNOWN
+    const struct nvgr_handle *h = (const struct nvgr_handle *)layer->handle;
+    if (!h || h->base.version != sizeof(native_handle_t))
+        return NULL;
+
+    // The handle must be at least as long as the part we read
+    size_t payload = (h->base.numFds + h->base.numInts) * sizeof(int);
+    if (payload < sizeof(*h) - sizeof(native_handle_t))
+        return NULL;
+
+    if (h->magic != (int)NVGR_HANDLE_MAGIC ||
+        h->surf_count < 1 || h->surf_count > NVGR_MAX_SURFACES)
+        return NULL;
+
+    return h;
+#else
+    return NULL;
+#endif
+}
+
+/* Returns the planes of a YUV420 planar buffer, or NULL if the handle isn't one */
+static const struct nvgr_handle *overlay_get_handle(hwc_layer_1_t *layer)
+{
+#if NVGR_LAYOUT_KNOWN
+    const struct nvgr_handle *h = nvgr_get_handle(layer);
+    if (!h || h->surf_count != 3)
+        return NULL;
+
+    const struct nvgr_surface *y = &h->surf[0];
+    const struct nvgr_surface *u = &h->surf[1];
+    const struct nvgr_surface *v = &h->surf[2];
+
+    if (y->color_format != NVGR_FORMAT_Y8 ||
+        u->color_format != NVGR_FORMAT_U8 ||
+        v->color_format != NVGR_FORMAT_V8)
+        return NULL;
+    if (!y->mem || !u->mem || !v->mem)
+        return NULL;
+    if (u->width != (y->width + 1) / 2 || u->height != (y->height + 1) / 2 ||
+        v->width != u->width || v->height != u->height)
+        return NULL;
+    if (y->pitch < y->width || u->pitch < u->width || v->pitch != u->pitch)
+        return NULL;
+
+    const hwc_rect_t &crop = layer->sourceCrop;
+    if (crop.left < 0 || crop.top < 0 ||
+        crop.right <= crop.left || crop.bottom <= crop.top ||
+        (uint32_t)crop.right > y->width || (uint32_t)crop.bottom > y->height)
+        return NULL;
+
+    return h;
+#else
+    return NULL;
+#endif
+}
+
+/* Claims a single, untransformed, full-screen YUV layer the v0 module declined */
+static void tegra2_overlay_prepare(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_display_contents_1_t *contents)
+{
+    if (pdev->overlay_win < 0 || contents->numHwLayers != 1)
+        return;
+
+    hwc_layer_1_t *layer = &contents->hwLayers[0];
+    if (layer->compositionType != HWC_FRAMEBUFFER ||
+        (layer->flags & HWC_SKIP_LAYER) || layer->transform != 0)
+        return;
+
+    if (layer->displayFrame.left != 0 || layer->displayFrame.top != 0 ||
+        layer->displayFrame.right != pdev->xres ||
+        layer->displayFrame.bottom != pdev->yres)
+        return;
+
+    if (!overlay_get_handle(layer))
+        return;
+
+    layer->compositionType = HWC_OVERLAY;
+    pdev->overlay_layer = 0;
+}
+
+/* Puts layer on the overlay window, or takes the window down if layer is NULL */
+static int tegra2_overlay_flip(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_layer_1_t *layer)
+{
+    struct tegra_dc_ext_flip flip;
+    memset(&flip, 0, sizeof(flip));
+    for (int i = 0; i < TEGRA_DC_EXT_FLIP_N_WINDOWS; i++)
+        flip.win[i].index = -1;
+
+    // A zero buff_id disables the window
+    struct tegra_dc_ext_flip_windowattr *win = &flip.win[0];
+    win->index = pdev->overlay_win;
+    win->pre_syncpt_id = NVHOST_INVALID_SYNCPOINT;
+
+    const struct nvgr_handle *h = layer ? overlay_get_handle(layer) : NULL;
+    if (h) {
+        const hwc_rect_t &crop = layer->sourceCrop;
+        const hwc_rect_t &frame = layer->displayFrame;
+
+        win->buff_id = h->surf[0].mem;
+        win->buff_id_u = h->surf[1].mem;
+        win->buff_id_v = h->surf[2].mem;
+        win->offset = h->surf[0].offset;
+        win->offset_u = h->surf[1].offset;
+        win->offset_v = h->surf[2].offset;
+        win->stride = h->surf[0].pitch;
+        win->stride_uv = h->surf[1].pitch;
+        win->pixformat = TEGRA_DC_EXT_FMT_YCbCr420P;
+        win->blend = TEGRA_DC_EXT_BLEND_NONE;
+
+        // Source is 20.12 fixed point, the DC scales it to the output
+        win->x = crop.left << 12;
+        win->y = crop.top << 12;
+        win->w = (crop.right - crop.left) << 12;
+        win->h = (crop.bottom - crop.top) << 12;
+        win->out_x = frame.left;
+        win->out_y = frame.top;
+        win->out_w = frame.right - frame.left;
+        win->out_h = frame.bottom - frame.top;
+
+        // Lowest z is nearest the viewer, above the framebuffer window
+        win->z = 0;
+    }
+
+    if (ioctl(pdev->dc_fd, TEGRA_DC_EXT_FLIP, &flip) < 0) {
+        ALOGE("overlay flip failed: %s", strerror(errno));
+        return -errno;
+    }
+    pdev->overlay_shown = h != NULL;
+
+    // There are no sync fences to hand back, so wait for the flip to land
+    // instead: once it has, the buffer it replaced is off screen and can be
+    // reused the moment SurfaceFlinger gets it back.
+    if (flip.post_syncpt_id != NVHOST_INVALID_SYNCPOINT && pdev->nvhost_fd >= 0) {
+        if (nvhost_syncpt_wait(pdev->nvhost_fd, flip.post_syncpt_id,
+                flip.post_syncpt_val, 2 * pdev->time_between_frames_us / 1000 + 1) < 0)
+            ALOGW("overlay flip did not complete in time");
+    }
+
+    return 0;
+}
+
+/*
+ * Gives the overlay window back for good. The frame being set has a hole
+ * where the video was, so ask for a redraw; prepare() leaves the layer to
+ * GL from then on.
+ */
+static void tegra2_overlay_release(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+    if (pdev->overlay_shown)
+        tegra2_overlay_flip(pdev, NULL);
+    ioctl(pdev->dc_fd, TEGRA_DC_EXT_PUT_WINDOW, pdev->overlay_win);
+    pdev->overlay_win = -1;
+    pdev->overlay_layer = -1;
+    pdev->overlay_shown = false;
+
+    if (pdev->procs && pdev->procs->invalidate)
+        pdev->procs->invalidate(pdev->procs);
+}
+
+#include <linux/nvmap.h>
+
+#define CURSOR_MAX_SIZE     64
+
+/* Claims the topmost layer if it is small and unscaled enough to be the pointer */
+static void tegra2_cursor_prepare(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_display_contents_1_t *contents)
+{
+    if (!pdev->cursor_ok || contents->numHwLayers < 2)
+        return;
+
+    size_t top = contents->numHwLayers - 1;
+    hwc_layer_1_t *layer = &contents->hwLayers[top];
+    if (layer->compositionType != HWC_FRAMEBUFFER ||
+        (layer->flags & HWC_SKIP_LAYER) || layer->transform != 0)
+        return;
+
+    const hwc_rect_t &crop = layer->sourceCrop;
+    const hwc_rect_t &frame = layer->displayFrame;
+    int w = frame.right - frame.left;
+    int h = frame.bottom - frame.top;
+    if (w <= 0 || h <= 0 || w > CURSOR_MAX_SIZE || h > CURSOR_MAX_SIZE ||
+        crop.right - crop.left != w || crop.bottom - crop.top != h)
+        return;
+
+    // Sprites are premultiplied; anything else is not the pointer
+    if (layer->blending != HWC_BLENDING_PREMULT)
+        return;
+
+    // A single RGBA plane we can read back
+#if NVGR_LAYOUT_KNOWN
+    const struct nvgr_handle *nh = nvgr_get_handle(layer);
+    if (!nh || nh->surf_count != 1 ||
+        nh->surf[0].color_format != NVGR_FORMAT_A8B8G8R8 ||
+        crop.left < 0 || crop.top < 0 ||
+        (uint32_t)crop.right > nh->surf[0].width ||
+        (uint32_t)crop.bottom > nh->surf[0].height ||
+        nh->surf[0].pitch < nh->surf[0].width * 4)
+        return;
+#else
+    return;
+#endif
+
+    layer->compositionType = HWC_OVERLAY;
+    pdev->cursor_layer = top;
+}
+
+/* A colour above its alpha isn't premultiplied, clamp it to white */
+static inline unsigned int cursor_unpremult(unsigned int c, unsigned int a)
+{
+    c = c * 255 / a;
+    return c > 255 ? 255 : c;
+}
+
+/*
+ * Reduces a premultiplied RGBA sprite to the DC's two-colour cursor: the
+ * first bitmap picks foreground or background, the second masks pixels out.
+ * Bright pixels become the foreground, dark ones the background, each
+ * coloured with the average of its pixels.
+ */
+static void cursor_convert(const uint8_t *src, int stride, int w, int h,
+        int size, uint8_t *image, uint32_t *fg, uint32_t *bg)
+{
+    const int row = size / 8;
+    uint8_t *color = image;
+    uint8_t *mask = image + row * size;
+    unsigned int sum[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+    unsigned int count[2] = { 0, 0 };
+
+    memset(color, 0x00, row * size);
+    memset(mask, 0xff, row * size);
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *p = src + y * stride;
+        for (int x = 0; x < w; x++, p += 4) {
+            unsigned int a = p[3];
+            if (a < 128)
+                continue;
+
+            unsigned int r = cursor_unpremult(p[0], a);
+            unsigned int g = cursor_unpremult(p[1], a);
+            unsigned int b = cursor_unpremult(p[2], a);
+            int bright = (r * 77 + g * 150 + b * 29) >> 15;  // luma >= 128
+            uint8_t bit = 0x80 >> (x & 7);
+
+            mask[y * row + x / 8] &= ~bit;
+            if (bright)
+                color[y * row + x / 8] |= bit;
+
+            sum[bright][0] += r;
+            sum[bright][1] += g;
+            sum[bright][2] += b;
+            count[bright]++;
+        }
+    }
+
+    *fg = count[1] ? (sum[1][0] / count[1]) << 16 | (sum[1][1] / count[1]) << 8 |
+            (sum[1][2] / count[1]) : 0xffffff;
+    *bg = count[0] ? (sum[0][0] / count[0]) << 16 | (sum[0][1] / count[0]) << 8 |
+            (sum[0][2] / count[0]) : 0x000000;
+}
+
+static int cursor_upload(struct tegra2_hwc_composer_device_1_t *pdev,
+        const uint8_t *image, int size, uint32_t fg, uint32_t bg)
+{
+    uint32_t flags = size == 32 ? TEGRA_DC_EXT_CURSOR_IMAGE_FLAGS_SIZE_32x32
+                                : TEGRA_DC_EXT_CURSOR_IMAGE_FLAGS_SIZE_64x64;
+    size_t len = 2 * size * size / 8;
+
+    // Pointer motion doesn't change the image; only push a new one
+    if (flags == pdev->cursor_flags && fg == pdev->cursor_fg && bg == pdev->cursor_bg &&
+        !memcmp(image, pdev->cursor_image, len))
+        return 0;
+
+    struct nvmap_rw_handle rw;
+    memset(&rw, 0, sizeof(rw));
+    rw.addr = (unsigned long)image;
+    rw.handle = pdev->cursor_mem;
+    rw.elem_size = len;
+    rw.hmem_stride = len;
+    rw.user_stride = len;
+    rw.count = 1;
+    if (ioctl(pdev->nvmap_fd, NVMAP_IOC_WRITE, &rw) < 0)
+        return -errno;
+
+    struct tegra_dc_ext_cursor_image ci;
+    memset(&ci, 0, sizeof(ci));
+    ci.foreground.r = fg >> 16;
+    ci.foreground.g = fg >> 8;
+    ci.foreground.b = fg;
+    ci.background.r = bg >> 16;
+    ci.background.g = bg >> 8;
+    ci.background.b = bg;
+    ci.buff_id = pdev->cursor_mem;
+    ci.flags = flags;
+    if (ioctl(pdev->dc_fd, TEGRA_DC_EXT_SET_CURSOR_IMAGE, &ci) < 0)
+        return -errno;
+
+    memcpy(pdev->cursor_image, image, len);
+    pdev->cursor_flags = flags;
+    pdev->cursor_fg = fg;
+    pdev->cursor_bg = bg;
+    return 0;
+}
+
+/* Moves the cursor to layer, updating its image if needed, or hides it if NULL */
+static void tegra2_cursor_set(struct tegra2_hwc_composer_device_1_t *pdev,
+        hwc_layer_1_t *layer)
+{
+    struct tegra_dc_ext_cursor pos;
+    memset(&pos, 0, sizeof(pos));
+
+    // SurfaceFlinger latches a new buffer for a new image, and the one
+    // on screen can't be handed back out meanwhile, so the same handle and
+    // crop as last time mean the same image
+    const hwc_rect_t *last = &pdev->cursor_crop;
+    if (layer && layer->handle == pdev->cursor_handle &&
+        !memcmp(&layer->sourceCrop, last, sizeof(*last))) {
+        // Just a move
+    } else if (layer) {
+        const struct nvgr_handle *nh = (const struct nvgr_handle *)layer->handle;
+        const hwc_rect_t &crop = layer->sourceCrop;
+        int w = crop.right - crop.left;
+        int h = crop.bottom - crop.top;
+        int size = (w <= 32 && h <= 32) ? 32 : 64;
+        uint8_t image[sizeof(pdev->cursor_image)];
+        uint32_t fg, bg;
+        void *vaddr;
+
+        if (pdev->gralloc->lock(pdev->gralloc, layer->handle,
+                GRALLOC_USAGE_SW_READ_OFTEN, crop.left, crop.top, w, h, &vaddr) < 0) {
+            ALOGW("Can't read the pointer sprite, leaving it to GL");
+            pdev->cursor_ok = false;
+            layer = NULL;
+        } else {
+            const uint8_t *src = (const uint8_t *)vaddr +
+                crop.top * nh->surf[0].pitch + crop.left * 4;
+            cursor_convert(src, nh->surf[0].pitch, w, h, size, image, &fg, &bg);
+            pdev->gralloc->unlock(pdev->gralloc, layer->handle);
+
+            int err = cursor_upload(pdev, image, size, fg, bg);
+            if (err < 0) {
+                ALOGE("Failed to set cursor image: %s", strerror(-err));
+                pdev->cursor_ok = false;
+                layer = NULL;
+            }
+        }
+    }
+
+    pdev->cursor_handle = layer ? layer->handle : NULL;
+    if (layer)
+        pdev->cursor_crop = layer->sourceCrop;
+
+    if (layer) {
+        pos.x = layer->displayFrame.left;
+        pos.y = layer->displayFrame.top;
+        pos.flags = TEGRA_DC_EXT_CURSOR_FLAGS_VISIBLE;
+    } else if (!pdev->cursor_shown) {
+        return;
+    }
+
+    // This one ioctl is all that pointer motion costs
+    if (ioctl(pdev->dc_fd, TEGRA_DC_EXT_SET_CURSOR, &pos) < 0) {
+        ALOGE("Failed to move cursor: %s", strerror(errno));
+        return;
+    }
+    pdev->cursor_shown = layer != NULL;
+}
+
+static void tegra2_cursor_open(struct tegra2_hwc_composer_device_1_t *dev)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    // Off unless asked for: any small premultiplied top layer passes for
+    // the pointer, and the DC can only show it in two colours. Without the
+    // handle layout no layer could ever be read, so don't take the buffer
+    property_get("persist.sys.hwc.cursor", value, "0");
+    if (!NVGR_LAYOUT_KNOWN || !atoi(value) || dev->dc_fd < 0 || dev->nvmap_fd < 0)
+        return;
+
+    if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID,
+            (const hw_module_t **)&dev->gralloc) != 0) {
+        ALOGW("No gralloc module, no hardware cursor");
+        return;
+    }
+
+    if (ioctl(dev->dc_fd, TEGRA_DC_EXT_GET_CURSOR) < 0) {
+        ALOGW("DC cursor unavailable: %s", strerror(errno));
+        return;
+    }
+
+    // The DC fetches the image from a contiguous, 1K aligned buffer
+    struct nvmap_create_handle create;
+    memset(&create, 0, sizeof(create));
+    create.size = sizeof(dev->cursor_image);
+    if (ioctl(dev->nvmap_fd, NVMAP_IOC_CREATE, &create) < 0) {
+        ALOGW("Failed to create cursor buffer: %s", strerror(errno));
+        ioctl(dev->dc_fd, TEGRA_DC_EXT_PUT_CURSOR);
+        return;
+    }
+
+    struct nvmap_alloc_handle alloc;
+    alloc.handle = create.handle;
+    alloc.heap_mask = NVMAP_HEAP_CARVEOUT_GENERIC;
+    alloc.flags = NVMAP_HANDLE_WRITE_COMBINE;
+    alloc.align = 1024;
+    if (ioctl(dev->nvmap_fd, NVMAP_IOC_ALLOC, &alloc) < 0) {
+        ALOGW("Failed to allocate cursor buffer: %s", strerror(errno));
+        ioctl(dev->nvmap_fd, NVMAP_IOC_FREE, create.handle);
+        ioctl(dev->dc_fd, TEGRA_DC_EXT_PUT_CURSOR);
+        return;
+    }
+
+    dev->cursor_mem = create.handle;
+    dev->cursor_ok = true;
+    ALOGD("Using the DC cursor for the pointer");
+}
+
+static void tegra2_cursor_close(struct tegra2_hwc_composer_device_1_t *dev)
+{
+    if (!dev->cursor_mem)
+        return;
+
+    if (dev->cursor_shown)
+        tegra2_cursor_set(dev, NULL);
+    ioctl(dev->dc_fd, TEGRA_DC_EXT_PUT_CURSOR);
+    ioctl(dev->nvmap_fd, NVMAP_IOC_FREE, dev->cursor_mem);
+    dev->cursor_mem = 0;
+    dev->cursor_ok = false;
+}
+
+static void tegra2_overlay_open(struct tegra2_hwc_composer_device_1_t *dev)
+{
+    char value[PROPERTY_VALUE_MAX];
+    bool overlay, cursor;
+
+    // Both the overlay and the cursor read the gralloc handle layout
+    // (nvgralloc.h); without it /dev/nvmap is left alone
+    if (!NVGR_LAYOUT_KNOWN) {
+        ALOGW("Gralloc handle layout unknown, no DC overlays");
+        return;
+    }
+
+    // Off unless asked for
+    property_get("persist.sys.hwc.overlay", value, "0");
+    overlay = atoi(value);
+    property_get("persist.sys.hwc.cursor", value, "0");
+    cursor = atoi(value);
+    if (!overlay && !cursor)
+        return;
+
+    dev->dc_fd = dc0_open();
+    dev->nvmap_fd = open("/dev/nvmap", O_RDWR);
+    if (dev->dc_fd < 0 || dev->nvmap_fd < 0 ||
+        ioctl(dev->dc_fd, TEGRA_DC_EXT_SET_NVMAP_FD, dev->nvmap_fd) < 0) {
+        ALOGW("DC overlay unavailable: %s", strerror(errno));
+        return;
+    }
+
+    if (overlay) {
+        for (size_t i = 0; i < sizeof(overlay_windows) / sizeof(overlay_windows[0]); i++) {
+            if (ioctl(dev->dc_fd, TEGRA_DC_EXT_GET_WINDOW, overlay_windows[i]) == 0) {
+                dev->overlay_win = overlay_windows[i];
+                ALOGD("Using DC window %d for video overlays", dev->overlay_win);
+                break;
+            }
+        }
+        if (dev->overlay_win < 0)
+            ALOGW("No free DC window for video overlays");
+    }
+
+    tegra2_cursor_open(dev);
+}
+
+static void tegra2_overlay_close(struct tegra2_hwc_composer_device_1_t *dev)
+{
+    if (dev->overlay_win >= 0) {
+        if (dev->overlay_shown)
+            tegra2_overlay_flip(dev, NULL);
+        ioctl(dev->dc_fd, TEGRA_DC_EXT_PUT_WINDOW, dev->overlay_win);
+        dev->overlay_win = -1;
+    }
+
+    tegra2_cursor_close(dev);
+
+    if (dev->nvmap_fd >= 0) {
+        close(dev->nvmap_fd);
+        dev->nvmap_fd = -1;
+    }
+    if (dev->dc_fd >= 0) {
+        close(dev->dc_fd);
+        dev->dc_fd = -1;
+    }
+}
+
+#endif /* TEGRA2_DC_OVERLAY */
+
+/* -- Colour management on the DC: per-window LUTs, and CSC on YUV windows */
+
+static int color_set_lut(int dc_fd, int win, uint16_t *r, uint16_t *g, uint16_t *b)
+{
+    struct tegra_dc_ext_lut lut;
+    lut.win_index = win;
+    lut.flags = TEGRA_DC_EXT_LUT_FLAGS_FBOVERRIDE;
+    lut.start = 0;
+    lut.len = COLOR_LUT_SIZE;
+    lut.r = r;
+    lut.g = g;
+    lut.b = b;
+    return ioctl(dc_fd, TEGRA_DC_EXT_SET_LUT, &lut);
+}
+
+static void tegra2_color_apply(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+    uint16_t r[COLOR_LUT_SIZE], g[COLOR_LUT_SIZE], b[COLOR_LUT_SIZE];
+
+    tegra2_color_lut(&pdev->color, r, g, b);
+
+    // The framebuffer window belongs to the fb driver. Hold it just long
+    // enough to set the LUT, then give it back; the LUT stays programmed.
+    bool win0 = pdev->dc_fd >= 0 &&
+        ioctl(pdev->dc_fd, TEGRA_DC_EXT_GET_WINDOW, 0) == 0;
+    if (win0) {
+        if (color_set_lut(pdev->dc_fd, 0, r, g, b) < 0)
+            ALOGE("Failed to set framebuffer LUT: %s", strerror(errno));
+        ioctl(pdev->dc_fd, TEGRA_DC_EXT_PUT_WINDOW, 0);
+    } else if (pdev->fb_fd >= 0) {
+        struct fb_cmap cmap;
+        memset(&cmap, 0, sizeof(cmap));
+        cmap.len = COLOR_LUT_SIZE;
+        cmap.red = r;
+        cmap.green = g;
+        cmap.blue = b;
+        if (ioctl(pdev->fb_fd, FBIOPUTCMAP, &cmap) < 0)
+            ALOGE("Failed to set framebuffer colormap: %s", strerror(errno));
+    }
+
+#ifdef TEGRA2_DC_OVERLAY
+    if (pdev->overlay_win >= 0) {
+        struct tegra_dc_ext_csc csc;
+        memset(&csc, 0, sizeof(csc));
+        csc.win_index = pdev->overlay_win;
+        tegra2_color_csc(&pdev->color, &csc);
+        if (ioctl(pdev->dc_fd, TEGRA_DC_EXT_SET_CSC, &csc) < 0 ||
+            color_set_lut(pdev->dc_fd, pdev->overlay_win, r, g, b) < 0)
+            ALOGE("Failed to set overlay colour: %s", strerror(errno));
+    }
+#endif
+
+    if (tegra2_color_has_cross_terms(&pdev->color))
+        ALOGI("Colour matrix cross terms only apply to video overlays");
+}
+
+/* Colour settings are properties; look at them about once a second */
+static void tegra2_color_check(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long now_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+    if (likely(now_ns - pdev->color_checked_ns < 1000000000ULL))
+        return;
+    pdev->color_checked_ns = now_ns;
+
+    struct tegra2_color color;
+    tegra2_color_load(&color);
+    if (!memcmp(&color, &pdev->color, sizeof(color)))
+        return;
+
+    pdev->color = color;
+    ALOGD("Colour transform changed, gamma %.2f", color.gamma);
+    tegra2_color_apply(pdev);
+}
+
+static void tegra2_color_open(struct tegra2_hwc_composer_device_1_t *dev)
+{
+    if (dev->dc_fd < 0)
+        dev->dc_fd = dc0_open();
+
+    tegra2_color_load(&dev->color);
+    if (!tegra2_color_is_identity(&dev->color))
+        tegra2_color_apply(dev);
+}
+
 static int tegra2_eventControl(struct hwc_composer_device_1 *dev, int dpy,
         int event, int enabled)
 {
@@ -574,6 +1338,155 @@ static int tegra2_eventControl(struct hwc_composer_device_1 *dev, int dpy,
     return ret;
 }
 
+/* -- HDMI hotplug, published for libnvshim's display info cache */
+
+#define HOTPLUG_PROP            "sys.hwc.hotplug"
+#define HOTPLUG_UEVENT          "change@/devices/virtual/switch/hdmi"
+
+/*
+ * Apps can't see the uevent socket, but can read a property's serial for
+ * free, so each HDMI switch change bumps sys.hwc.hotplug. The thread blocks
+ * in the uevent socket for the life of the process and is never joined.
+ */
+static void *tegra2_hotplug_thread(void *data)
+{
+    char uevent[1024];
+    char value[PROPERTY_VALUE_MAX];
+    unsigned int count = 0;
+
+    if (!uevent_init()) {
+        ALOGE("Unable to listen for hotplug uevents");
+        return NULL;
+    }
+
+    for (;;) {
+        int len = uevent_next_event(uevent, sizeof(uevent) - 2);
+        if (len <= 0 || strcmp(uevent, HOTPLUG_UEVENT))
+            continue;
+
+        snprintf(value, sizeof(value), "%u", ++count);
+        property_set(HOTPLUG_PROP, value);
+        ALOGD("HDMI hotplug %u", count);
+    }
+
+    return NULL;
+}
+
+static void tegra2_hotplug_open(void)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, tegra2_hotplug_thread, NULL))
+        ALOGE("Unable to start hotplug thread");
+    pthread_attr_destroy(&attr);
+}
+
+/* -- Panel power */
+
+static unsigned long long monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Called with power_mutex held */
+static int fb_set_blank(struct tegra2_hwc_composer_device_1_t *pdev, int mode)
+{
+    if (ioctl(pdev->fb_fd, FBIOBLANK, mode) < 0)
+        return -errno;
+
+    unsigned long long now_ns = monotonic_ns();
+
+    if (mode == FB_BLANK_UNBLANK) {
+        pdev->blanked_total_ns += now_ns - pdev->blank_ns;
+    } else {
+        pdev->blank_count++;
+        pdev->blank_ns = now_ns;
+    }
+
+    pdev->fb_blank_mode = mode;
+    return 0;
+}
+
+static void tegra2_power_open(struct tegra2_hwc_composer_device_1_t *dev)
+{
+    pthread_mutex_init(&dev->power_mutex, NULL);
+    dev->fb_blank_mode = FB_BLANK_UNBLANK;
+}
+
+static void tegra2_power_close(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+    pthread_mutex_destroy(&pdev->power_mutex);
+}
+
+/*
+ * The Tegra2 fb driver disables the DC for every blank mode, so there is
+ * no cheaper FB_BLANK_NORMAL to stop at: power straight down.
+ */
+static void tegra2_power_blank(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+#ifdef TEGRA2_DC_OVERLAY
+    // Our windows would come back with stale contents on unblank
+    if (pdev->overlay_shown)
+        tegra2_overlay_flip(pdev, NULL);
+    if (pdev->cursor_shown)
+        tegra2_cursor_set(pdev, NULL);
+#endif
+
+    pthread_mutex_lock(&pdev->power_mutex);
+    if (pdev->fb_blank_mode == FB_BLANK_UNBLANK) {
+        int err = fb_set_blank(pdev, FB_BLANK_POWERDOWN);
+        if (err < 0)
+            ALOGE("Failed to blank display: %s", strerror(-err));
+    }
+    pthread_mutex_unlock(&pdev->power_mutex);
+}
+
+/*
+ * How long this takes on the device has not been measured yet; the time
+ * is logged and averaged in dump() so that it can be.
+ */
+static void tegra2_power_unblank(struct tegra2_hwc_composer_device_1_t *pdev)
+{
+    pthread_mutex_lock(&pdev->power_mutex);
+    if (pdev->fb_blank_mode == FB_BLANK_UNBLANK) {
+        pthread_mutex_unlock(&pdev->power_mutex);
+        return;
+    }
+
+    unsigned long long start_ns = monotonic_ns();
+    int err = fb_set_blank(pdev, FB_BLANK_UNBLANK);
+    if (err == 0) {
+        // Put the last frame back up until SurfaceFlinger posts a new one
+        struct fb_var_screeninfo info;
+        if (ioctl(pdev->fb_fd, FBIOGET_VSCREENINFO, &info) < 0 ||
+            ioctl(pdev->fb_fd, FBIOPAN_DISPLAY, &info) < 0)
+            ALOGW("Failed to restore the last frame: %s", strerror(errno));
+    }
+    unsigned long long us = (monotonic_ns() - start_ns) / 1000;
+
+    if (err == 0) {
+        pdev->unblank_count++;
+        pdev->unblank_us += us;
+    }
+    pthread_mutex_unlock(&pdev->power_mutex);
+
+    if (err < 0) {
+        ALOGE("Failed to unblank display: %s", strerror(-err));
+        return;
+    }
+    ALOGI("Display on in %lluus", us);
+
+    // The DC lost its cursor image and LUTs with its power
+    pdev->cursor_flags = 0;
+    if (!tegra2_color_is_identity(&pdev->color))
+        tegra2_color_apply(pdev);
+}
+
 static int tegra2_blank(struct hwc_composer_device_1 *dev, int disp, int blank)
 {
     struct tegra2_hwc_composer_device_1_t *pdev =
@@ -581,13 +1494,19 @@ static int tegra2_blank(struct hwc_composer_device_1 *dev, int disp, int blank)
 
     ALOGD("blank: %d", blank);
 
+    if (pdev->fb_fd >= 0 && !blank)
+        tegra2_power_unblank(pdev);
+
     // Store framebuffer status
     pthread_mutex_lock(&pdev->vsync_mutex);
     pdev->fbblanked = blank;
     pthread_cond_signal(&pdev->vsync_cond);
     pthread_mutex_unlock(&pdev->vsync_mutex);
 
-    /* Blanking is handled by other means, no need to blank screen here */
+    // VSYNC is parked by now, no VBLANK wait is left on a dying DC
+    if (pdev->fb_fd >= 0 && blank)
+        tegra2_power_blank(pdev);
+
     return 0;
 }
 
@@ -644,6 +1563,27 @@ static void tegra2_dump(hwc_composer_device_1* dev, char *buff, int buff_len)
         pdev->org->dump(pdev->org,buff,buff_len);
     else
         *buff = 0;
+
+    if (pdev->nvhost_fd >= 0) {
+        size_t len = strnlen(buff, buff_len);
+        snprintf(buff + len, buff_len - len,
+            "  VBLANK syncpt %u (%s): at %u, %llu reported, %llu missed\n",
+            pdev->vblank_syncpt_id,
+            pdev->vblank_waitex ? "waitex" : "read+wait",
+            pdev->vblank_value, pdev->vblank_reported, pdev->vblank_missed);
+    }
+
+    if (pdev->fb_fd >= 0) {
+        pthread_mutex_lock(&pdev->power_mutex);
+        size_t len = strnlen(buff, buff_len);
+        snprintf(buff + len, buff_len - len,
+            "  Display %s: %u powerdowns, off %llus, on in %lluus avg (%u)\n",
+            pdev->fb_blank_mode == FB_BLANK_UNBLANK ? "on" : "powered down",
+            pdev->blank_count, pdev->blanked_total_ns / 1000000000ULL,
+            pdev->unblank_count ? pdev->unblank_us / pdev->unblank_count : 0ULL,
+            pdev->unblank_count);
+        pthread_mutex_unlock(&pdev->power_mutex);
+    }
 }
 
 static int tegra2_close(hw_device_t *device)
@@ -666,6 +1606,16 @@ static int tegra2_close(hw_device_t *device)
     pthread_mutex_destroy(&pdev->vsync_mutex);
     pthread_cond_destroy(&pdev->vsync_cond);
 
+    tegra2_power_close(pdev);
+#ifdef TEGRA2_DC_OVERLAY
+    // Needs nvhost to wait for the window to go down
+    tegra2_overlay_close(pdev);
+#endif
+    if (pdev->dc_fd >= 0) {
+        close(pdev->dc_fd);
+        pdev->dc_fd = -1;
+    }
+
     // Close NVidia host handle, if being used...
     if (pdev->nvhost_fd >= 0) {
         nvhost_close(pdev->nvhost_fd);
@@ -802,6 +1752,14 @@ static int tegra2_open(const struct hw_module_t *module, const char *name,
         // Get the syncpoint id for VBLANK0
         dev->vblank_syncpt_id = dc0_get_vblank_syncpt();
 
+        // Only a version that predates it rules SYNCPT_WAITEX out. Without
+        // GET_VERSION, try it: the first wait falls back on ENOTTY/EINVAL
+        int version = nvhost_get_version(dev->nvhost_fd);
+        dev->vblank_waitex = version < 0 || version >= NVHOST_SUBMIT_VERSION_V1;
+        dev->vblank_resync = true;
+        ALOGD("Waiting for VBLANK with %s",
+            dev->vblank_waitex ? "SYNCPT_WAITEX" : "SYNCPT_READ+WAIT");
+
         dev->vsync_running = true;
         if (pthread_create(&dev->vsync_thread, NULL, tegra2_hwc_nv_vsync_thread, dev)) {
             ALOGE("Unable to start VSYNC thread");
@@ -817,6 +1775,18 @@ static int tegra2_open(const struct hw_module_t *module, const char *name,
         }
     }
 
+    dev->dc_fd = -1;
+    dev->nvmap_fd = -1;
+    dev->overlay_win = -1;
+    dev->overlay_layer = -1;
+    dev->cursor_layer = -1;
+#ifdef TEGRA2_DC_OVERLAY
+    tegra2_overlay_open(dev);
+#endif
+    tegra2_color_open(dev);
+    tegra2_power_open(dev);
+    tegra2_hotplug_open();
+
     *device = &dev->base.common;
 
     return 0;
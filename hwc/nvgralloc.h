@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEGRA2_NVGRALLOC_H
+#define TEGRA2_NVGRALLOC_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <cutils/native_handle.h>
+
+/*
+ * Leading part of the buffer handle the Tegra2 gralloc blob hands out.
+ * The layout is private to the blob, so anything read through it must be
+ * checked against what the layer says before it reaches the hardware.
+ *
+ * It has not been checked against any particular blob release. The handle
+ * magic and the NvColorFormat values of the Y, U and V planes and of RGBA
+ * (R in the lowest byte) differ between releases, so they come from the
+ * board (BOARD_TEGRA2_NVGR_* in hwc/Android.mk). Without them no handle is
+ * trusted and NVGR_LAYOUT_KNOWN is 0.
+ */
+
+#if defined(NVGR_HANDLE_MAGIC) && defined(NVGR_FORMAT_Y8) && \
+    defined(NVGR_FORMAT_U8) && defined(NVGR_FORMAT_V8) && \
+    defined(NVGR_FORMAT_A8B8G8R8)
+#define NVGR_LAYOUT_KNOWN   1
+#else
+#define NVGR_LAYOUT_KNOWN   0
+#endif
+
+#define NVGR_MAX_SURFACES   3
+
+/* NvRmSurface: one plane of a buffer. */
+struct nvgr_surface {
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    color_format;
+    uint32_t    layout;
+    uint32_t    pitch;
+    uint32_t    mem;            /* NvRmMemHandle, the nvmap handle id */
+    uint32_t    offset;         /* of the plane within mem */
+    void*       base;
+    uint32_t    kind;
+    uint32_t    block_height_log2;
+};
+
+struct nvgr_handle {
+    native_handle_t base;
+    int         mem_fd;
+    int         magic;
+    pid_t       owner;
+    void*       buf;
+    uint32_t    surf_count;     /* 1 for RGB, 3 for planar YUV */
+    struct nvgr_surface surf[NVGR_MAX_SURFACES];
+};
+
+#endif /* TEGRA2_NVGRALLOC_H */
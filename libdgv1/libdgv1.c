@@ -5,6 +5,8 @@
 #include <utils/Log.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
 
 /*
  * CURIOUS WHAT THE HELL IS GOING ON IN HERE? READ UP...
@@ -44,26 +46,100 @@ struct NvOsLibraryHandle;
 
 NvError NvOsLibraryLoad(const char *name, struct NvOsLibraryHandle *library);
 
+/*
+ * Resolution cache. Most NV libraries (EGL/GLES sub-libraries in particular)
+ * only load with the /system/lib/ prefix. Remember which names needed it so
+ * later loads go straight to the path that works. The cache is per process
+ * and libdgv1 is not loaded in zygote, so this only saves repeated lookups
+ * within one process. Entries are only ever added, under the lock, and a
+ * slot is published by the release store of libldr_cache_used that follows
+ * filling it in, so lookups need no lock.
+ */
+#define LIBLDR_PREFIX           "/system/lib/"
+#define LIBLDR_CACHE_ENTRIES    32
+#define LIBLDR_NAME_MAX         64
+
+struct libldr_cache_entry {
+    uint32_t hash;
+    char name[LIBLDR_NAME_MAX];
+};
+
+static struct libldr_cache_entry libldr_cache[LIBLDR_CACHE_ENTRIES];
+static uint32_t libldr_cache_used;
+static uint32_t libldr_cache_hits;
+static uint32_t libldr_cache_misses;
+static pthread_mutex_t libldr_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t libldr_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;    // FNV-1a
+
+    while (*name)
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+
+    return hash;
+}
+
+static int libldr_cache_lookup(const char *name, uint32_t hash)
+{
+    uint32_t i, used = __atomic_load_n(&libldr_cache_used, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < used; i++) {
+        if (libldr_cache[i].hash == hash && !strcmp(libldr_cache[i].name, name))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void libldr_cache_insert(const char *name, uint32_t hash)
+{
+    uint32_t used;
+
+    if (strlen(name) >= LIBLDR_NAME_MAX)
+        return;
+
+    pthread_mutex_lock(&libldr_cache_lock);
+    used = libldr_cache_used;
+    if (used < LIBLDR_CACHE_ENTRIES && !libldr_cache_lookup(name, hash)) {
+        libldr_cache[used].hash = hash;
+        strcpy(libldr_cache[used].name, name);
+        __atomic_store_n(&libldr_cache_used, used + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&libldr_cache_lock);
+}
+
 NvError dmitrygr_libldr(const char *name, struct NvOsLibraryHandle *library)
 {
-    static const char *prepend = "/system/lib/";
-    char *path;
+    char path[PATH_MAX];
+    uint32_t hash;
     NvError err;
 
+    if (snprintf(path, sizeof(path), "%s%s", LIBLDR_PREFIX, name) >= (int)sizeof(path))
+        return NvOsLibraryLoad(name, library);
+
+    //we've been here before, and only the full path worked
+    hash = libldr_hash(name);
+    if (libldr_cache_lookup(name, hash)) {
+        __atomic_fetch_add(&libldr_cache_hits, 1, __ATOMIC_RELAXED);
+        err = NvOsLibraryLoad(path, library);
+        if (!err)
+            return err;
+        return NvOsLibraryLoad(name, library);
+    }
+
     err = NvOsLibraryLoad(name, library);
     if (!err)
         return err;
 
     //now try full path
     //then try in /system/lib
-    path = malloc(strlen(name) + strlen(prepend) + 1);
-    if (!path)
-        return err;
-    sprintf(path, "%s%s", prepend, name);
+    __atomic_fetch_add(&libldr_cache_misses, 1, __ATOMIC_RELAXED);
     err = NvOsLibraryLoad(path, library);
-    if (!err)
+    if (!err) {
         ALOGV("Just saved you by loading '%s' instead of '%s'", path, name);
-    free(path);
+        libldr_cache_insert(name, hash);
+    }
 
     return err;
 }
@@ -76,3 +152,10 @@ void libEvtLoading(void)
 
 }
 
+void libEvtUnloading(void) __attribute__((destructor));
+void libEvtUnloading(void)
+{
+    ALOGV("Path cache: %u entries, %u hits, %u misses\n", libldr_cache_used,
+            libldr_cache_hits, libldr_cache_misses);
+}
+
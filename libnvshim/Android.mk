@@ -26,3 +26,17 @@ LOCAL_SRC_FILES := libnvshim.c
 LOCAL_MODULE := libnvshim
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
+
+# Host benchmark for the display info cache, against stubbed libgui
+include $(CLEAR_VARS)
+
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+
+LOCAL_CFLAGS += -Wpointer-arith
+LOCAL_SRC_FILES := libnvshim.c tests/nvshim_bench.c
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MULTILIB := 32
+
+LOCAL_MODULE := nvshim_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
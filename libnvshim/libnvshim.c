@@ -18,9 +18,111 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <cutils/properties.h>
 #include <utils/Log.h>
 
+/*
+ * Shim instrumentation. Every export below bumps a per-symbol call counter;
+ * those are relaxed atomics and cost a few nanoseconds. Per-call logging and
+ * cumulative timing are expensive (a logd write and two clock reads) so they
+ * are opt-in:
+ *
+ *   setprop debug.nvshim.log 1     log every shim call
+ *   setprop debug.nvshim.stats 1   accumulate time spent in every shim
+ *
+ * Properties are sampled once when the library is loaded. The table is dumped
+ * via nvshim_dump_stats() and on library unload.
+ */
+#define NVSHIM_PROP_LOG     "debug.nvshim.log"
+#define NVSHIM_PROP_STATS   "debug.nvshim.stats"
+
+enum {
+    SHIM_GET_DISPLAY_INFO,
+    SHIM_SET_LAYER,
+    SHIM_SET_POSITION,
+    SHIM_CREATE_SURFACE,
+    SHIM_COMPOSER_SET_ORIENTATION,
+    SHIM_CLIENT_SET_ORIENTATION,
+    SHIM_MEMORY_DEALER,
+    SHIM_NUM_SYMBOLS
+};
+
+struct shim_stat {
+    const char *name;
+    uint32_t calls;
+    uint64_t time_ns;
+};
+
+static struct shim_stat shim_stats[SHIM_NUM_SYMBOLS] = {
+    [SHIM_GET_DISPLAY_INFO]         = { "_ZN7android21SurfaceComposerClient14getDisplayInfoEiPNS_11DisplayInfoE", 0, 0 },
+    [SHIM_SET_LAYER]                = { "_ZN7android14SurfaceControl8setLayerEi", 0, 0 },
+    [SHIM_SET_POSITION]             = { "_ZN7android14SurfaceControl11setPositionEii", 0, 0 },
+    [SHIM_CREATE_SURFACE]           = { "_ZN7android21SurfaceComposerClient13createSurfaceEijjij", 0, 0 },
+    [SHIM_COMPOSER_SET_ORIENTATION] = { "_ZN7android8Composer14setOrientationEi", 0, 0 },
+    [SHIM_CLIENT_SET_ORIENTATION]   = { "_ZN7android21SurfaceComposerClient14setOrientationEiij", 0, 0 },
+    [SHIM_MEMORY_DEALER]            = { "_ZN7android12MemoryDealerC1EjPKc", 0, 0 },
+};
+
+/*
+ * Display and composer cache. The NV EGL and winsys stack keeps asking for the
+ * main display's info, and each query is a getBuiltInDisplay plus a binder
+ * round trip to SurfaceFlinger. The token never changes and the info only
+ * changes on rotation or hotplug, so both are kept here. External (HDMI)
+ * displays come and go on hotplug and are always forwarded. Set
+ * debug.nvshim.nocache to bypass the cache entirely.
+ *
+ * The hwcomposer bumps sys.hwc.hotplug on every HDMI hotplug. Its serial is
+ * a plain read from the shared property area, so each cache hit checks it.
+ */
+#define NVSHIM_PROP_NOCACHE "debug.nvshim.nocache"
+#define NVSHIM_PROP_HOTPLUG "sys.hwc.hotplug"
+
+#define DISPLAY_ID_MAIN     0
+
+// sizeof(android::DisplayInfo): w, h, xdpi, ydpi, fps, density, orientation,
+// secure, appVsyncOffset, presentationDeadline
+#define DISPLAY_INFO_SIZE   48
+
+static pthread_mutex_t display_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *display_cache_token;   // sp<IBinder> of the main display
+static uint8_t display_cache_info[DISPLAY_INFO_SIZE];
+static int display_cache_valid;
+static int display_cache_disabled;
+static uint32_t display_cache_hits;
+static const struct prop_info *display_hotplug_prop;
+static unsigned int display_hotplug_serial;
+
+static int shim_log_calls;
+static int shim_time_calls;
+
+static inline uint64_t shim_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t shim_enter(int sym)
+{
+    __atomic_fetch_add(&shim_stats[sym].calls, 1, __ATOMIC_RELAXED);
+
+    if (__builtin_expect(shim_log_calls, 0))
+        ALOGI("%s", shim_stats[sym].name);
+
+    return __builtin_expect(shim_time_calls, 0) ? shim_now_ns() : 0;
+}
+
+static inline void shim_leave(int sym, uint64_t start)
+{
+    if (__builtin_expect(start != 0, 0))
+        __atomic_fetch_add(&shim_stats[sym].time_ns, shim_now_ns() - start, __ATOMIC_RELAXED);
+}
+
 //various funcs we'll need to call, in their mangled form
 
     // // android::String8::String8(void)
@@ -74,6 +176,10 @@
     //  android::MemoryDealer::MemoryDealer(android::MemoryDealer *this, unsigned int, const char *, unsigned int)
     extern void* _ZN7android12MemoryDealerC2EjPKcj(void *this, uint32_t size, const char* name, uint32_t flags);
 
+    // bionic, <sys/_system_properties.h>
+    extern const struct prop_info *__system_property_find(const char *name);
+    extern unsigned int __system_property_serial(const struct prop_info *pi);
+
 
 //code exports we provide
 
@@ -104,6 +210,12 @@
     // android::MemoryDealer::MemoryDealer(android::MemoryDealer *this, unsigned int, const char *)
     void* _ZN7android12MemoryDealerC1EjPKc(void *this, uint32_t size, const char* name);
 
+    // dump per-symbol call counts (and times, if enabled) to the log
+    void nvshim_dump_stats(void);
+
+    // drop the cached main display info (on hotplug or orientation change)
+    void nvshim_invalidate_display_cache(void);
+
 
 //library on-load and on-unload handlers (to help us set things up and tear them down)
     void libEvtLoading(void) __attribute__((constructor));
@@ -111,28 +223,88 @@
 
 /*
  * FUNCTION:    android::SurfaceComposerClient::getDisplayInfo(int, android::DisplayInfo *)
- *
+ * USE:         libEGL_tegra.so, libnvwinsys.so
+ * NOTES:       The main display is answered from the display cache once it has
+ *              been queried successfully; everything else goes to SurfaceFlinger.
  */
 int _ZN7android21SurfaceComposerClient14getDisplayInfoEiPNS_11DisplayInfoE(int32_t a1, int32_t a2, int32_t a3) {
 
-    ALOGI("_ZN7android21SurfaceComposerClient14getDisplayInfoEiPNS_11DisplayInfoE");
+    uint64_t start = shim_enter(SHIM_GET_DISPLAY_INFO);
+    void *info = (void*)(intptr_t)a2;
+    void *instance;
     int res;
-    void *instance = &a2;
-    _ZN7android21SurfaceComposerClient17getBuiltInDisplayEi(&instance, a1);
-     res = _ZN7android21SurfaceComposerClient14getDisplayInfoERKNS_2spINS_7IBinderEEEPNS_11DisplayInfoE(
-        &instance,
-        instance);
-    _ZN7android2spINS_7IBinderEED2Ev(&instance);
+
+    (void) a3;
+
+    if (a1 != DISPLAY_ID_MAIN || display_cache_disabled) {
+        _ZN7android21SurfaceComposerClient17getBuiltInDisplayEi(&instance, a1);
+        res = _ZN7android21SurfaceComposerClient14getDisplayInfoERKNS_2spINS_7IBinderEEEPNS_11DisplayInfoE(
+            &instance,
+            info);
+        _ZN7android2spINS_7IBinderEED2Ev(&instance);
+        shim_leave(SHIM_GET_DISPLAY_INFO, start);
+        return res;
+    }
+
+    pthread_mutex_lock(&display_cache_lock);
+
+    // the property only exists after the first hotplug
+    if (!display_hotplug_prop)
+        display_hotplug_prop = __system_property_find(NVSHIM_PROP_HOTPLUG);
+    if (display_hotplug_prop &&
+            __system_property_serial(display_hotplug_prop) != display_hotplug_serial) {
+        display_hotplug_serial = __system_property_serial(display_hotplug_prop);
+        display_cache_valid = 0;
+    }
+
+    if (display_cache_valid) {
+        memcpy(info, display_cache_info, DISPLAY_INFO_SIZE);
+        pthread_mutex_unlock(&display_cache_lock);
+        __atomic_fetch_add(&display_cache_hits, 1, __ATOMIC_RELAXED);
+        shim_leave(SHIM_GET_DISPLAY_INFO, start);
+        return 0;
+    }
+
+    // the token is kept (and referenced) for the lifetime of the library
+    if (!display_cache_token)
+        _ZN7android21SurfaceComposerClient17getBuiltInDisplayEi(&display_cache_token, a1);
+
+    res = _ZN7android21SurfaceComposerClient14getDisplayInfoERKNS_2spINS_7IBinderEEEPNS_11DisplayInfoE(
+        &display_cache_token,
+        info);
+    if (!res) {
+        memcpy(display_cache_info, info, DISPLAY_INFO_SIZE);
+        display_cache_valid = 1;
+    }
+    pthread_mutex_unlock(&display_cache_lock);
+
+    shim_leave(SHIM_GET_DISPLAY_INFO, start);
     return res;
 }
 
+/*
+ * FUNCTION:    nvshim_invalidate_display_cache()
+ * USE:         Called on orientation change; hotplug is seen through
+ *              sys.hwc.hotplug
+ * NOTES:       Only the cached DisplayInfo is dropped; the main display token
+ *              stays valid for as long as SurfaceFlinger does.
+ */
+void nvshim_invalidate_display_cache(void)
+{
+    pthread_mutex_lock(&display_cache_lock);
+    display_cache_valid = 0;
+    pthread_mutex_unlock(&display_cache_lock);
+}
+
 /*
  * FUNCTION:    android::SurfaceControl::setLayer(unsigned int)
  * USE:         libnvwinsys.so
  */
 int _ZN7android14SurfaceControl8setLayerEi(void *surfaceControl, int32_t layer) {
-    ALOGI("_ZN7android14SurfaceControl8setLayerEi");
-    return _ZN7android14SurfaceControl8setLayerEj(surfaceControl, (uint32_t)layer);
+    uint64_t start = shim_enter(SHIM_SET_LAYER);
+    int res = _ZN7android14SurfaceControl8setLayerEj(surfaceControl, (uint32_t)layer);
+    shim_leave(SHIM_SET_LAYER, start);
+    return res;
 }
 
 /*
@@ -140,8 +312,10 @@ int _ZN7android14SurfaceControl8setLayerEi(void *surfaceControl, int32_t layer)
  * USE:         libnvwinsys.so
  */
 int _ZN7android14SurfaceControl11setPositionEii(void *surfaceControl, int32_t x, int32_t y) {
-    ALOGI("_ZN7android14SurfaceControl11setPositionEii");
-    return _ZN7android14SurfaceControl11setPositionEff(surfaceControl, (float)x, (float)y);
+    uint64_t start = shim_enter(SHIM_SET_POSITION);
+    int res = _ZN7android14SurfaceControl11setPositionEff(surfaceControl, (float)x, (float)y);
+    shim_leave(SHIM_SET_POSITION, start);
+    return res;
 }
 
 /*
@@ -162,7 +336,7 @@ void* _ZN7android21SurfaceComposerClient13createSurfaceEijjij(
     // snprintf(buffer, SIZE, "<pid_%d>", getpid());
     // name.append(buffer);
 
-    ALOGI("_ZN7android21SurfaceComposerClient13createSurfaceEijjij");
+    uint64_t start = shim_enter(SHIM_CREATE_SURFACE);
 
     (void) display;
 
@@ -180,6 +354,7 @@ void* _ZN7android21SurfaceComposerClient13createSurfaceEijjij(
         flags);
     _ZN7android7String8D1Ev(&name);
 
+    shim_leave(SHIM_CREATE_SURFACE, start);
     return surfaceComposerClient;
 }
 
@@ -192,8 +367,10 @@ int _ZN7android8Composer14setOrientationEi(void *this, int orientation)
     void* composerService;
     void* token;
     void* dispState;
+    uint64_t start = shim_enter(SHIM_COMPOSER_SET_ORIENTATION);
 
     // sp<ISurfaceComposer> sm(ComposerService::getComposerService());
+    // ComposerService keeps the connection itself, this is only a ref bump
     composerService = _ZN7android15ComposerService18getComposerServiceEv(this);
 
     // sp<IBinder> token(sm->getBuiltInDisplay(ISurfaceComposer::eDisplayIdMain))
@@ -213,6 +390,10 @@ int _ZN7android8Composer14setOrientationEi(void *this, int orientation)
     _ZN7android2spINS_7IBinderEED2Ev(&token);
     _ZN7android2spINS_7IBinderEED2Ev(&composerService);
 
+    // a rotated display reports swapped dimensions
+    nvshim_invalidate_display_cache();
+
+    shim_leave(SHIM_COMPOSER_SET_ORIENTATION, start);
     return 0;
 }
 
@@ -225,8 +406,12 @@ int _ZN7android21SurfaceComposerClient14setOrientationEiij(void *this, int32_t d
     (void) dpy;
     (void) flags;
     void* instance;
+    uint64_t start = shim_enter(SHIM_CLIENT_SET_ORIENTATION);
+    int res;
      instance = _ZN7android9SingletonINS_8ComposerEE11getInstanceEv(this);
-    return _ZN7android8Composer14setOrientationEi(&instance, orientation);
+    res = _ZN7android8Composer14setOrientationEi(&instance, orientation);
+    shim_leave(SHIM_CLIENT_SET_ORIENTATION, start);
+    return res;
 }
 
 /*
@@ -236,10 +421,39 @@ int _ZN7android21SurfaceComposerClient14setOrientationEiij(void *this, int32_t d
 void* _ZN7android12MemoryDealerC1EjPKc(void *this, uint32_t size, const char* name)
 {
     void* instance = this;
+    uint64_t start = shim_enter(SHIM_MEMORY_DEALER);
     _ZN7android12MemoryDealerC2EjPKcj(instance, size, name, 0);
+    shim_leave(SHIM_MEMORY_DEALER, start);
     return instance;
 }
 
+/*
+ * FUNCTION: nvshim_dump_stats()
+ * USE:      Debugging aid, may be called from anywhere in the process
+ * NOTES:    Counters are read without stopping the shims, so the dump is only
+ *           a snapshot. Times are only meaningful with debug.nvshim.stats set.
+ */
+void nvshim_dump_stats(void)
+{
+    int i;
+
+    for (i = 0; i < SHIM_NUM_SYMBOLS; i++) {
+        uint32_t calls = __atomic_load_n(&shim_stats[i].calls, __ATOMIC_RELAXED);
+        uint64_t time_ns = __atomic_load_n(&shim_stats[i].time_ns, __ATOMIC_RELAXED);
+
+        if (!calls)
+            continue;
+
+        if (shim_time_calls)
+            ALOGI("%s: %u calls, %llu ns total, %llu ns avg", shim_stats[i].name, calls,
+                    (unsigned long long)time_ns, (unsigned long long)(time_ns / calls));
+        else
+            ALOGI("%s: %u calls", shim_stats[i].name, calls);
+    }
+
+    ALOGI("display info cache: %u hits", __atomic_load_n(&display_cache_hits, __ATOMIC_RELAXED));
+}
+
 /*
  * FUNCTION: libEvtLoading()
  * USE:      Handle library loading
@@ -248,6 +462,10 @@ void* _ZN7android12MemoryDealerC1EjPKc(void *this, uint32_t size, const char* na
  */
 void libEvtLoading(void)
 {
+    shim_log_calls = property_get_bool(NVSHIM_PROP_LOG, 0);
+    shim_time_calls = property_get_bool(NVSHIM_PROP_STATS, 0);
+    display_cache_disabled = property_get_bool(NVSHIM_PROP_NOCACHE, 0);
+
     ALOGI("NVidia interposition library loaded.");
 }
 
@@ -258,5 +476,9 @@ void libEvtLoading(void)
  */
 void libEvtUnloading(void)
 {
+    nvshim_dump_stats();
+
+    if (display_cache_token)
+        _ZN7android2spINS_7IBinderEED2Ev(&display_cache_token);
     ALOGI("NVidia interposition library unloaded.");
 }
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark for the libnvshim display info cache. libgui, libutils and
+ * the bionic property area are replaced by the stubs below; every stubbed
+ * binder call spins for a fixed time, 40us by default, roughly a round trip
+ * to SurfaceFlinger on Tegra2.
+ *
+ *   nvshim_bench [iterations] [binder_us]
+ *
+ * Prints the per-call time of the cached and forwarded paths, and fails if
+ * the cache misses or hits when it shouldn't. The shim passes pointers as
+ * int32_t like the ARM callers do, so this is built 32-bit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define DISPLAY_INFO_SIZE   48
+
+static uint64_t binder_ns = 40000;
+static unsigned int binder_calls;
+static unsigned int token_refs;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void binder_transact(void)
+{
+    uint64_t end = now_ns() + binder_ns;
+
+    binder_calls++;
+    while (now_ns() < end)
+        ;
+}
+
+/* -- libgui / libutils stubs */
+
+static int display_token = 0x1b1d;
+static uint8_t display_info_gen;
+
+void* _ZN7android21SurfaceComposerClient17getBuiltInDisplayEi(void *ret, int32_t id)
+{
+    (void) id;
+    binder_transact();
+    token_refs++;
+    *(void **)ret = &display_token;
+    return ret;
+}
+
+int _ZN7android21SurfaceComposerClient14getDisplayInfoERKNS_2spINS_7IBinderEEEPNS_11DisplayInfoE(
+        void **display, void *info)
+{
+    if (*display != &display_token)
+        return -22;
+    binder_transact();
+    memset(info, display_info_gen, DISPLAY_INFO_SIZE);
+    return 0;
+}
+
+int _ZN7android2spINS_7IBinderEED2Ev(void *sp)
+{
+    if (*(void **)sp == &display_token)
+        token_refs--;
+    return 0;
+}
+
+void _ZN7android7String8C1Ev(void **str8P) { (void) str8P; }
+void _ZN7android7String8D1Ev(void **str8P) { (void) str8P; }
+void _ZN7android7String86appendEPKc(void **str8P, const char *other) { (void) str8P; (void) other; }
+int _ZN7android14SurfaceControl8setLayerEj(void *sc, uint32_t layer) { (void) sc; (void) layer; return 0; }
+int _ZN7android14SurfaceControl11setPositionEff(void *sc, float x, float y) { (void) sc; (void) x; (void) y; return 0; }
+void* _ZN7android21SurfaceComposerClient13createSurfaceERKNS_7String8Ejjij(void *scc,
+        void **name, uint32_t w, uint32_t h, int32_t format, uint32_t flags)
+{
+    (void) name; (void) w; (void) h; (void) format; (void) flags;
+    return scc;
+}
+void* _ZN7android9SingletonINS_8ComposerEE11getInstanceEv(void *this) { return this; }
+void* _ZN7android15ComposerService18getComposerServiceEv(void *this) { return this; }
+int _ZN7android8Composer21getDisplayStateLockedERKNS_2spINS_7IBinderEEE(void *this, void **binder)
+{
+    (void) this; (void) binder;
+    return 0;
+}
+int _ZN7android8Composer17getBuiltInDisplayEi(void *this, int32_t id) { (void) this; (void) id; return 0; }
+void* _ZN7android12MemoryDealerC2EjPKcj(void *this, uint32_t size, const char* name, uint32_t flags)
+{
+    (void) size; (void) name; (void) flags;
+    return this;
+}
+
+/* -- bionic property area stubs: sys.hwc.hotplug appears on the first hotplug */
+
+struct prop_info {
+    unsigned int serial;
+};
+
+static struct prop_info hotplug_prop;
+static int hotplug_prop_exists;
+
+const struct prop_info *__system_property_find(const char *name)
+{
+    if (strcmp(name, "sys.hwc.hotplug") || !hotplug_prop_exists)
+        return NULL;
+    return &hotplug_prop;
+}
+
+unsigned int __system_property_serial(const struct prop_info *pi)
+{
+    return pi->serial;
+}
+
+static void hotplug(void)
+{
+    hotplug_prop_exists = 1;
+    hotplug_prop.serial += 2;
+    display_info_gen++;
+}
+
+/* -- the shim */
+
+extern int _ZN7android21SurfaceComposerClient14getDisplayInfoEiPNS_11DisplayInfoE(int32_t a1, int32_t a2, int32_t a3);
+extern void nvshim_invalidate_display_cache(void);
+
+static uint8_t info[DISPLAY_INFO_SIZE];
+static int failures;
+
+static int get_display_info(int32_t dpy)
+{
+    return _ZN7android21SurfaceComposerClient14getDisplayInfoEiPNS_11DisplayInfoE(
+            dpy, (int32_t)(intptr_t)info, 0);
+}
+
+static void expect(const char *what, int32_t dpy, unsigned int transactions)
+{
+    unsigned int before = binder_calls;
+
+    if (get_display_info(dpy) || info[0] != display_info_gen) {
+        printf("FAIL %s: wrong display info\n", what);
+        failures++;
+    } else if (binder_calls - before != transactions) {
+        printf("FAIL %s: %u binder calls, expected %u\n", what,
+                binder_calls - before, transactions);
+        failures++;
+    }
+}
+
+static void bench(const char *what, int32_t dpy, int iterations, int invalidate)
+{
+    unsigned int before = binder_calls;
+    uint64_t start = now_ns();
+    int i;
+
+    for (i = 0; i < iterations; i++) {
+        if (invalidate)
+            nvshim_invalidate_display_cache();
+        get_display_info(dpy);
+    }
+
+    printf("%-28s %10.0f ns/call %8.2f binder calls/call\n", what,
+            (double)(now_ns() - start) / iterations,
+            (double)(binder_calls - before) / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+    if (argc > 2)
+        binder_ns = strtoull(argv[2], NULL, 0) * 1000;
+    if (iterations <= 0)
+        iterations = 2000;
+
+    /* the first query fetches the token and the info, later ones are free */
+    expect("first query", 0, 2);
+    expect("cached query", 0, 0);
+
+    /* rotation keeps the token and refetches only the info */
+    nvshim_invalidate_display_cache();
+    expect("after rotation", 0, 1);
+    expect("cached after rotation", 0, 0);
+
+    /* so does hotplug, both when the property appears and when it changes */
+    hotplug();
+    expect("first hotplug", 0, 1);
+    expect("cached after hotplug", 0, 0);
+    hotplug();
+    expect("second hotplug", 0, 1);
+
+    /* external displays are never cached, nor is their token kept */
+    expect("external display", 1, 2);
+    expect("external display again", 1, 2);
+    if (token_refs != 1) {
+        printf("FAIL: %u display token references held, expected 1\n", token_refs);
+        failures++;
+    }
+
+    printf("%d iterations, %llu us per binder call\n", iterations,
+            (unsigned long long)(binder_ns / 1000));
+    bench("main display, cached", 0, iterations, 0);
+    bench("main display, invalidated", 0, iterations, 1);
+    bench("external display (uncached)", 1, iterations, 0);
+
+    if (failures)
+        printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -19,6 +19,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
     NVOMXPlugin.cpp                      \
+    NVOMXTrace.cpp                       \
 
 LOCAL_CFLAGS := $(PV_CFLAGS_MINUS_VISIBILITY)
 
@@ -37,3 +38,38 @@ LOCAL_MODULE := libstagefrighthw
 
 include $(BUILD_SHARED_LIBRARY)
 
+
+# Host stand-in for libnvomx.so, with injectable latencies and errors
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := tests/fake_nvomx.cpp
+LOCAL_C_INCLUDES := frameworks/native/include/media/openmax
+
+LOCAL_MODULE := libnvomx_fake
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+# Host test and benchmark for the plugin against libnvomx_fake
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    NVOMXPlugin.cpp                      \
+    NVOMXTrace.cpp                       \
+    tests/nvomx_test.cpp                 \
+
+LOCAL_CFLAGS := \
+        '-DNVOMX_LIB=getenv("NVOMX_LIB")' \
+        -DNVOMX_MANIFEST='"/tmp/nvomx_test_components"' \
+        -DNVOMX_TRACE_FILE='"/tmp/nvomx_test_trace.txt"'
+
+LOCAL_C_INCLUDES := \
+        frameworks/native/include/media/openmax \
+        frameworks/native/include/media/hardware
+
+LOCAL_SHARED_LIBRARIES := libnvomx_fake
+LOCAL_STATIC_LIBRARIES := libutils libcutils liblog
+LOCAL_LDLIBS := -ldl -lpthread -lrt
+
+LOCAL_MODULE := nvomx_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
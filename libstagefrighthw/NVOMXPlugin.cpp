@@ -15,6 +15,7 @@
  */
 
 #include "NVOMXPlugin.h"
+#include "NVOMXTrace.h"
 
 #define LOG_TAG "NVOMXPlugin"
 
@@ -22,18 +23,40 @@
 
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
+#include <cutils/properties.h>
 #include <media/hardware/HardwareAPI.h>
 
+// Paths can be overridden from the build to drive the plugin against a
+// stand-in library off the device.
+#ifndef NVOMX_LIB
+#define NVOMX_LIB               "/system/lib/libnvomx.so"
+#endif
+#ifndef NVOMX_MANIFEST
+#define NVOMX_MANIFEST          "/data/misc/media/nvomx_components"
+#endif
+#define NVOMX_MANIFEST_LINE     512
+#define NVOMX_PROP_LAZY         "ro.nvomx.lazy"
+#define NVOMX_PROP_POOL_SIZE    "ro.nvomx.pool_size"
+
 namespace android {
 
 OMXPluginBase *createOMXPlugin() {
     return new NVOMXPlugin;
 }
 
+NVOMXPlugin *NVOMXPlugin::sPlugin;
+
 NVOMXPlugin::NVOMXPlugin()
-    : mLibHandle(dlopen("/system/lib/libnvomx.so", RTLD_NOW)),
+    : mLibHandle(NULL),
+      mLoadFailed(false),
+      mPoolSize(0),
       mInit(NULL),
       mDeinit(NULL),
       mComponentNameEnum(NULL),
@@ -41,34 +64,187 @@ NVOMXPlugin::NVOMXPlugin()
       mFreeHandle(NULL),
       mGetRolesOfComponentHandle(NULL) {
 
+    sPlugin = this;
+    // Off unless asked for: an idle pooled decoder keeps its AVP and
+    // carveout memory, and only parameters, not configs, are put back
+    // between clients.
+    int32_t poolSize = property_get_int32(NVOMX_PROP_POOL_SIZE, 0);
+    mPoolSize = poolSize > 0 ? poolSize : 0;
+
+    bool lazy = property_get_bool(NVOMX_PROP_LAZY, true);
+
+    // With a current manifest the NV multimedia stack is not touched until
+    // the first component is instantiated.
+    if (lazy && loadManifest()) {
+        ALOGV("using %s, deferring libnvomx", NVOMX_MANIFEST);
+        return;
+    }
+
+    if (load() && lazy) {
+        writeManifest();
+    }
+}
+
+bool NVOMXPlugin::load() {
+    Mutex::Autolock autoLock(mLock);
+    return loadLocked();
+}
+
+bool NVOMXPlugin::loadLocked() {
     if (mLibHandle != NULL) {
-        mInit = (InitFunc)dlsym(mLibHandle, "OMX_Init");
-        mDeinit = (DeinitFunc)dlsym(mLibHandle, "OMX_Deinit");
-
-        mComponentNameEnum =
-            (ComponentNameEnumFunc)dlsym(mLibHandle, "OMX_ComponentNameEnum");
-
-        mGetHandle = (GetHandleFunc)dlsym(mLibHandle, "OMX_GetHandle");
-        mFreeHandle = (FreeHandleFunc)dlsym(mLibHandle, "OMX_FreeHandle");
-
-        mGetRolesOfComponentHandle =
-            (GetRolesOfComponentFunc)dlsym(
-                    mLibHandle, "OMX_GetRolesOfComponent");
-
-        if (!mInit || !mDeinit || !mComponentNameEnum || !mGetHandle ||
-             !mFreeHandle || !mGetRolesOfComponentHandle) {
-            ALOGE("Error with dlsym()");
-            dlclose(mLibHandle);
-            mLibHandle = NULL;
-        } else
-        (*mInit)();
+        return true;
+    }
+
+    if (mLoadFailed) {
+        return false;
+    }
+
+    mLoadFailed = true;
+
+    mLibHandle = dlopen(NVOMX_LIB, RTLD_NOW);
+    if (mLibHandle == NULL) {
+        ALOGE("%s", dlerror());
+        return false;
+    }
+
+    mInit = (InitFunc)dlsym(mLibHandle, "OMX_Init");
+    mDeinit = (DeinitFunc)dlsym(mLibHandle, "OMX_Deinit");
+
+    mComponentNameEnum =
+        (ComponentNameEnumFunc)dlsym(mLibHandle, "OMX_ComponentNameEnum");
+
+    mGetHandle = (GetHandleFunc)dlsym(mLibHandle, "OMX_GetHandle");
+    mFreeHandle = (FreeHandleFunc)dlsym(mLibHandle, "OMX_FreeHandle");
+
+    mGetRolesOfComponentHandle =
+        (GetRolesOfComponentFunc)dlsym(
+                mLibHandle, "OMX_GetRolesOfComponent");
+
+    if (!mInit || !mDeinit || !mComponentNameEnum || !mGetHandle ||
+         !mFreeHandle || !mGetRolesOfComponentHandle) {
+        ALOGE("Error with dlsym()");
+        dlclose(mLibHandle);
+        mLibHandle = NULL;
+        return false;
+    }
+
+    if ((*mInit)() == OMX_ErrorNone && mComponents.isEmpty()) {
+        buildRegistry();
+    }
+
+    mLoadFailed = false;
+    return true;
+}
+
+// The manifest records what libnvomx reported the last time it was loaded,
+// stamped with the size and mtime of the library so a new blob forces a
+// fresh enumeration.
+static bool nvomx_stamp(unsigned long long *size, long long *mtime) {
+    struct stat st;
+
+    if (stat(NVOMX_LIB, &st) < 0) {
+        return false;
+    }
+
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+bool NVOMXPlugin::loadManifest() {
+    unsigned long long size, msize;
+    long long mtime, mmtime;
+    char line[NVOMX_MANIFEST_LINE];
+    bool ok = false;
+
+    if (!nvomx_stamp(&size, &mtime)) {
+        return false;
+    }
+
+    FILE *fp = fopen(NVOMX_MANIFEST, "r");
+    if (fp == NULL) {
+        return false;
+    }
+
+    if (fgets(line, sizeof(line), fp) == NULL ||
+            sscanf(line, "libnvomx %llu %lld", &msize, &mmtime) != 2 ||
+            msize != size || mmtime != mtime) {
+        goto exit;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *save = NULL;
+        char *name = strtok_r(line, " \n", &save);
+        char *err = strtok_r(NULL, " \n", &save);
+
+        if (name == NULL || err == NULL) {
+            goto exit;
+        }
+
+        Component component;
+        component.mName.setTo(name);
+        component.mRolesErr = (OMX_ERRORTYPE)strtoul(err, NULL, 16);
+
+        char *role;
+        while ((role = strtok_r(NULL, " \n", &save)) != NULL) {
+            component.mRoles.push(String8(role));
+        }
+
+        mComponents.push(component);
+    }
+
+    ok = !mComponents.isEmpty();
+
+exit:
+    fclose(fp);
+    if (!ok) {
+        mComponents.clear();
+    }
+    return ok;
+}
+
+void NVOMXPlugin::writeManifest() const {
+    unsigned long long size;
+    long long mtime;
+
+    if (mComponents.isEmpty() || !nvomx_stamp(&size, &mtime)) {
+        return;
+    }
+
+    FILE *fp = fopen(NVOMX_MANIFEST ".tmp", "w");
+    if (fp == NULL) {
+        ALOGW("unable to write %s: %s", NVOMX_MANIFEST, strerror(errno));
+        return;
+    }
+
+    fprintf(fp, "libnvomx %llu %lld\n", size, mtime);
+    for (size_t i = 0; i < mComponents.size(); ++i) {
+        const Component &component = mComponents[i];
+
+        fprintf(fp, "%s %x", component.mName.string(), component.mRolesErr);
+        for (size_t j = 0; j < component.mRoles.size(); ++j) {
+            fprintf(fp, " %s", component.mRoles[j].string());
+        }
+        fputc('\n', fp);
+    }
+
+    if (fclose(fp) == 0) {
+        rename(NVOMX_MANIFEST ".tmp", NVOMX_MANIFEST);
     } else {
-        ALOGE(dlerror());
+        unlink(NVOMX_MANIFEST ".tmp");
     }
 }
 
 NVOMXPlugin::~NVOMXPlugin() {
     if (mLibHandle != NULL) {
+        for (size_t i = 0; i < mIdle.size(); ++i) {
+            (*mFreeHandle)(
+                    reinterpret_cast<OMX_HANDLETYPE *>(mIdle[i]->mComponent));
+            dropDefaults(mIdle[i], false);
+            delete mIdle[i];
+        }
+        mIdle.clear();
+
         (*mDeinit)();
 
         dlclose(mLibHandle);
@@ -82,12 +258,29 @@ OMX_ERRORTYPE NVOMXPlugin::makeComponentInstance(
         OMX_PTR appData,
         OMX_COMPONENTTYPE **component) {
     OMX_ERRORTYPE err = OMX_ErrorUndefined;
-    if (mLibHandle == NULL) {
+    NVOMXTrace *trace = NULL;
+    if (!load()) {
         goto exit;
     }
-    err = (*mGetHandle)(reinterpret_cast<OMX_HANDLETYPE *>(component),
-            const_cast<char *>(name), appData,
-                const_cast<OMX_CALLBACKTYPE *>(callbacks));
+    if (NVOMXTrace::enabled()) {
+        trace = NVOMXTrace::create(name, callbacks, appData);
+    }
+    if (trace != NULL) {
+        callbacks = trace->callbacks();
+        appData = trace->appData();
+    }
+    if (poolable(name)) {
+        *component = takeIdle(name, callbacks, appData);
+        err = *component != NULL ? OMX_ErrorNone :
+                makeBound(name, callbacks, appData, component);
+    } else {
+        err = (*mGetHandle)(reinterpret_cast<OMX_HANDLETYPE *>(component),
+                const_cast<char *>(name), appData,
+                    const_cast<OMX_CALLBACKTYPE *>(callbacks));
+    }
+    if (trace != NULL && (err != OMX_ErrorNone || !trace->attach(*component))) {
+        delete trace;
+    }
     if (strncmp(name, "OMX.Nvidia.drm.play", 19) == 0) {
         gOMXDrmPlayComponent = *component;
     }
@@ -99,27 +292,321 @@ exit:
 OMX_ERRORTYPE NVOMXPlugin::destroyComponentInstance(
         OMX_COMPONENTTYPE *component) {
     OMX_ERRORTYPE err = OMX_ErrorUndefined;
+    NVOMXTrace *trace;
     if (mLibHandle == NULL) {
         goto exit;
     }
     if (component == gOMXDrmPlayComponent) {
         gOMXDrmPlayComponent = NULL;
     }
-    err = (*mFreeHandle)(reinterpret_cast<OMX_HANDLETYPE *>(component));
+
+    // Unhook the tracer first so a pooled instance goes back clean. Its
+    // callbacks keep working until the component is freed or parked.
+    trace = NVOMXTrace::detach(component);
+
+    if (!release(component, &err)) {
+        err = (*mFreeHandle)(reinterpret_cast<OMX_HANDLETYPE *>(component));
+    }
+
+    if (trace != NULL) {
+        trace->dump();
+        delete trace;
+    }
 
 exit:
     return err;
 }
 
+// Decoders are the instances worth keeping: freeing one makes the AVP
+// reload its firmware state, which dominates a short-lived codec such as
+// a thumbnail decode.
+bool NVOMXPlugin::poolable(const char *name) const {
+    return mPoolSize > 0 && !strncmp(name, "OMX.Nvidia.", 11) &&
+            strstr(name, ".decode") != NULL;
+}
+
+OMX_COMPONENTTYPE *NVOMXPlugin::takeIdle(
+        const char *name,
+        const OMX_CALLBACKTYPE *callbacks,
+        OMX_PTR appData) {
+    Mutex::Autolock autoLock(mLock);
+
+    for (size_t i = 0; i < mIdle.size(); ++i) {
+        Binding *binding = mIdle[i];
+
+        if (strcmp(binding->mName.string(), name)) {
+            continue;
+        }
+
+        mIdle.removeAt(i);
+        binding->mCallbacks = *callbacks;
+        binding->mAppData = appData;
+        mActive.push(binding);
+
+        ALOGV("reusing pooled %s", name);
+        return binding->mComponent;
+    }
+
+    return NULL;
+}
+
+OMX_ERRORTYPE NVOMXPlugin::makeBound(
+        const char *name,
+        const OMX_CALLBACKTYPE *callbacks,
+        OMX_PTR appData,
+        OMX_COMPONENTTYPE **component) {
+    Binding *binding = new Binding;
+
+    binding->mName.setTo(name);
+    binding->mForward.EventHandler = OnEvent;
+    binding->mForward.EmptyBufferDone = OnEmptyBufferDone;
+    binding->mForward.FillBufferDone = OnFillBufferDone;
+    binding->mCallbacks = *callbacks;
+    binding->mAppData = appData;
+    binding->mNoReuse = false;
+
+    OMX_ERRORTYPE err = (*mGetHandle)(
+            reinterpret_cast<OMX_HANDLETYPE *>(component),
+            const_cast<char *>(name), binding, &binding->mForward);
+    if (err != OMX_ErrorNone) {
+        delete binding;
+        return err;
+    }
+
+    binding->mComponent = *component;
+    binding->mSetParameter = (*component)->SetParameter;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        mActive.push(binding);
+    }
+
+    (*component)->SetParameter = SetParameter;
+    return OMX_ErrorNone;
+}
+
+// Parks a bound instance if it is back in Loaded state and every standard
+// parameter its client set could be put back. Vendor extension parameters
+// cannot be read back, so an instance that was given any is freed.
+// Returns false for components that were not made through a binding.
+bool NVOMXPlugin::release(OMX_COMPONENTTYPE *component, OMX_ERRORTYPE *err) {
+    Binding *binding = NULL;
+    size_t idle = 0;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        for (size_t i = 0; i < mActive.size(); ++i) {
+            if (mActive[i]->mComponent == component) {
+                binding = mActive[i];
+                break;
+            }
+        }
+
+        if (binding == NULL) {
+            return false;
+        }
+
+        for (size_t i = 0; i < mIdle.size(); ++i) {
+            if (mIdle[i]->mName == binding->mName) {
+                ++idle;
+            }
+        }
+    }
+
+    OMX_STATETYPE state = OMX_StateInvalid;
+    bool park = idle < mPoolSize && !binding->mNoReuse &&
+            (*component->GetState)(component, &state) == OMX_ErrorNone &&
+            state == OMX_StateLoaded;
+
+    if (park && dropDefaults(binding, true)) {
+        Mutex::Autolock autoLock(mLock);
+
+        mActive.removeAt(mActive.indexOf(binding));
+        memset(&binding->mCallbacks, 0, sizeof(binding->mCallbacks));
+        binding->mAppData = NULL;
+        mIdle.push(binding);
+
+        *err = OMX_ErrorNone;
+        return true;
+    }
+
+    // The binding stays findable until the component's own SetParameter is
+    // back, see SetParameter().
+    component->SetParameter = binding->mSetParameter;
+    {
+        Mutex::Autolock autoLock(mLock);
+        mActive.removeAt(mActive.indexOf(binding));
+    }
+
+    *err = (*mFreeHandle)(reinterpret_cast<OMX_HANDLETYPE *>(component));
+    dropDefaults(binding, false);
+    delete binding;
+    return true;
+}
+
+// Standard parameter structures start with nSize and nVersion; for most the
+// next field is the port index, so it is kept as part of the key.
+void NVOMXPlugin::saveDefault(
+        Binding *binding, OMX_INDEXTYPE index, OMX_PTR params) {
+    const OMX_U32 *header = static_cast<const OMX_U32 *>(params);
+
+    if (header == NULL || header[0] < 2 * sizeof(OMX_U32)) {
+        binding->mNoReuse = true;
+        return;
+    }
+
+    OMX_U32 size = header[0];
+    OMX_U32 key = size >= 3 * sizeof(OMX_U32) ? header[2] : 0;
+
+    for (size_t i = 0; i < binding->mDefaults.size(); ++i) {
+        const Default &saved = binding->mDefaults[i];
+        if (saved.mIndex == index && saved.mKey == key) {
+            return;
+        }
+    }
+
+    Default saved;
+    saved.mIndex = index;
+    saved.mKey = key;
+    saved.mParams = malloc(size);
+    if (saved.mParams == NULL) {
+        binding->mNoReuse = true;
+        return;
+    }
+
+    memcpy(saved.mParams, params, size);
+    OMX_COMPONENTTYPE *component = binding->mComponent;
+    if ((*component->GetParameter)(component, index, saved.mParams) !=
+            OMX_ErrorNone) {
+        free(saved.mParams);
+        binding->mNoReuse = true;
+        return;
+    }
+
+    binding->mDefaults.push(saved);
+}
+
+// Frees the saved defaults, first setting them back newest first when
+// restore is set. Returns false if the component refused any of them.
+bool NVOMXPlugin::dropDefaults(Binding *binding, bool restore) {
+    bool ok = true;
+
+    for (size_t i = binding->mDefaults.size(); i-- > 0; ) {
+        const Default &saved = binding->mDefaults[i];
+
+        if (restore && ok && (*binding->mSetParameter)(binding->mComponent,
+                saved.mIndex, saved.mParams) != OMX_ErrorNone) {
+            ALOGW("%s: unable to reset parameter 0x%x",
+                    binding->mName.string(), saved.mIndex);
+            ok = false;
+        }
+        free(saved.mParams);
+    }
+
+    binding->mDefaults.clear();
+    return ok;
+}
+
+OMX_ERRORTYPE NVOMXPlugin::OnEvent(
+        OMX_HANDLETYPE component, OMX_PTR appData, OMX_EVENTTYPE event,
+        OMX_U32 data1, OMX_U32 data2, OMX_PTR eventData) {
+    Binding *binding = static_cast<Binding *>(appData);
+
+    if (binding->mCallbacks.EventHandler == NULL) {
+        return OMX_ErrorNone;
+    }
+
+    return (*binding->mCallbacks.EventHandler)(
+            component, binding->mAppData, event, data1, data2, eventData);
+}
+
+OMX_ERRORTYPE NVOMXPlugin::OnEmptyBufferDone(
+        OMX_HANDLETYPE component, OMX_PTR appData,
+        OMX_BUFFERHEADERTYPE *header) {
+    Binding *binding = static_cast<Binding *>(appData);
+
+    if (binding->mCallbacks.EmptyBufferDone == NULL) {
+        return OMX_ErrorNone;
+    }
+
+    return (*binding->mCallbacks.EmptyBufferDone)(
+            component, binding->mAppData, header);
+}
+
+OMX_ERRORTYPE NVOMXPlugin::OnFillBufferDone(
+        OMX_HANDLETYPE component, OMX_PTR appData,
+        OMX_BUFFERHEADERTYPE *header) {
+    Binding *binding = static_cast<Binding *>(appData);
+
+    if (binding->mCallbacks.FillBufferDone == NULL) {
+        return OMX_ErrorNone;
+    }
+
+    return (*binding->mCallbacks.FillBufferDone)(
+            component, binding->mAppData, header);
+}
+
+OMX_ERRORTYPE NVOMXPlugin::SetParameter(
+        OMX_HANDLETYPE component, OMX_INDEXTYPE index, OMX_PTR params) {
+    NVOMXPlugin *plugin = sPlugin;
+    Binding *binding = NULL;
+
+    {
+        Mutex::Autolock autoLock(plugin->mLock);
+
+        for (size_t i = 0; i < plugin->mActive.size(); ++i) {
+            if (plugin->mActive[i]->mComponent == component) {
+                binding = plugin->mActive[i];
+                break;
+            }
+        }
+        for (size_t i = 0; binding == NULL && i < plugin->mIdle.size(); ++i) {
+            if (plugin->mIdle[i]->mComponent == component) {
+                binding = plugin->mIdle[i];
+            }
+        }
+    }
+
+    // Not ours any more. release() puts the component's own entry point
+    // back before it lets go of the binding.
+    if (binding == NULL) {
+        OMX_COMPONENTTYPE *self = static_cast<OMX_COMPONENTTYPE *>(component);
+
+        if (self->SetParameter == SetParameter) {
+            return OMX_ErrorInvalidComponent;
+        }
+        return (*self->SetParameter)(component, index, params);
+    }
+
+    if (index >= OMX_IndexVendorStartUnused) {
+        binding->mNoReuse = true;
+    } else if (!binding->mNoReuse) {
+        saveDefault(binding, index, params);
+    }
+
+    return (*binding->mSetParameter)(component, index, params);
+}
+
 OMX_ERRORTYPE NVOMXPlugin::enumerateComponents(
         OMX_STRING name,
         size_t size,
         OMX_U32 index) {
-    if (mLibHandle == NULL) {
+    if (mComponents.isEmpty()) {
         return OMX_ErrorUndefined;
     }
 
-    return (*mComponentNameEnum)(name, size, index);
+    if (index >= mComponents.size()) {
+        return OMX_ErrorNoMore;
+    }
+
+    const String8 &component = mComponents[index].mName;
+    if (component.length() >= size) {
+        return OMX_ErrorBadParameter;
+    }
+
+    memcpy(name, component.string(), component.length() + 1);
+    return OMX_ErrorNone;
 }
 
 OMX_ERRORTYPE NVOMXPlugin::getRolesOfComponent(
@@ -127,49 +614,89 @@ OMX_ERRORTYPE NVOMXPlugin::getRolesOfComponent(
         Vector<String8> *roles) {
     roles->clear();
 
-    if (mLibHandle == NULL) {
+    if (mComponents.isEmpty()) {
         return OMX_ErrorUndefined;
     }
 
+    const Component *component = findComponent(name);
+    if (component == NULL) {
+        return OMX_ErrorInvalidComponentName;
+    }
+
+    if (component->mRolesErr != OMX_ErrorNone) {
+        return component->mRolesErr;
+    }
+
+    // Shares the registry's storage, no copy is made.
+    *roles = component->mRoles;
+    return OMX_ErrorNone;
+}
+
+void NVOMXPlugin::buildRegistry() {
+    char name[OMX_MAX_STRINGNAME_SIZE];
+
+    for (OMX_U32 index = 0; ; ++index) {
+        if ((*mComponentNameEnum)(name, sizeof(name), index) != OMX_ErrorNone) {
+            break;
+        }
+
+        Component component;
+        component.mName.setTo(name);
+        component.mRolesErr = queryRoles(name, &component.mRoles);
+        mComponents.push(component);
+    }
+
+    ALOGV("cached %d components", (int)mComponents.size());
+}
+
+OMX_ERRORTYPE NVOMXPlugin::queryRoles(
+        const char *name,
+        Vector<String8> *roles) {
     OMX_U32 numRoles;
     OMX_ERRORTYPE err = (*mGetRolesOfComponentHandle)(
             const_cast<OMX_STRING>(name), &numRoles, NULL);
 
-    if (err != OMX_ErrorNone) {
+    if (err != OMX_ErrorNone || numRoles == 0) {
         return err;
     }
 
-    if (numRoles > 0) {
-        OMX_U8 **array = new OMX_U8 *[numRoles];
-        for (OMX_U32 i = 0; i < numRoles; ++i) {
-            array[i] = new OMX_U8[OMX_MAX_STRINGNAME_SIZE];
-        }
+    OMX_U8 *storage = new OMX_U8[numRoles * OMX_MAX_STRINGNAME_SIZE];
+    OMX_U8 **array = new OMX_U8 *[numRoles];
+    for (OMX_U32 i = 0; i < numRoles; ++i) {
+        array[i] = storage + i * OMX_MAX_STRINGNAME_SIZE;
+        array[i][0] = '\0';
+    }
 
-        OMX_U32 numRoles2;
-        err = (*mGetRolesOfComponentHandle)(
-                const_cast<OMX_STRING>(name), &numRoles2, array);
+    OMX_U32 numRoles2 = numRoles;
+    err = (*mGetRolesOfComponentHandle)(
+            const_cast<OMX_STRING>(name), &numRoles2, array);
 
-    if (err != OMX_ErrorNone) {
-      return err;
-    }
+    if (err == OMX_ErrorNone) {
+        if (numRoles2 > numRoles) {
+            numRoles2 = numRoles;
+        }
 
-    if (numRoles2 != numRoles) {
-      return err;
+        for (OMX_U32 i = 0; i < numRoles2; ++i) {
+            array[i][OMX_MAX_STRINGNAME_SIZE - 1] = '\0';
+            roles->push(String8((const char *)array[i]));
+        }
     }
 
-        for (OMX_U32 i = 0; i < numRoles; ++i) {
-            String8 s((const char *)array[i]);
-            roles->push(s);
+    delete[] array;
+    delete[] storage;
 
-            delete[] array[i];
-            array[i] = NULL;
-        }
+    return err;
+}
 
-        delete[] array;
-        array = NULL;
+const NVOMXPlugin::Component *NVOMXPlugin::findComponent(
+        const char *name) const {
+    for (size_t i = 0; i < mComponents.size(); ++i) {
+        if (!strcmp(mComponents[i].mName.string(), name)) {
+            return &mComponents[i];
+        }
     }
 
-    return OMX_ErrorNone;
+    return NULL;
 }
 
 }  // namespace android
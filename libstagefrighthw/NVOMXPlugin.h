@@ -19,6 +19,7 @@
 #define NV_OMX_PLUGIN_H_
 
 #include <media/hardware/OMXPluginBase.h>
+#include <utils/threads.h>
 
 OMX_COMPONENTTYPE *gOMXDrmPlayComponent;
 
@@ -47,7 +48,48 @@ struct NVOMXPlugin : public OMXPluginBase {
             Vector<String8> *roles);
 
 private:
+    // Component names and roles never change once libnvomx is up, so they
+    // are read once after OMX_Init and every later query is answered from
+    // here.
+    struct Component {
+        String8 mName;
+        Vector<String8> mRoles;
+        OMX_ERRORTYPE mRolesErr;
+    };
+
+    // The value a parameter had before the current client first set it,
+    // keyed by index and the port (or first field) after the header.
+    struct Default {
+        OMX_INDEXTYPE mIndex;
+        OMX_U32 mKey;
+        OMX_PTR mParams;
+    };
+
+    // A pooled instance is created against a Binding, whose forwarders
+    // pass callbacks on to whichever client currently owns it. Reuse only
+    // has to repoint the binding, the component never sees new callbacks.
+    struct Binding {
+        String8 mName;
+        OMX_COMPONENTTYPE *mComponent;
+        OMX_CALLBACKTYPE mForward;
+        OMX_CALLBACKTYPE mCallbacks;
+        OMX_PTR mAppData;
+        OMX_ERRORTYPE (*mSetParameter)(
+                OMX_HANDLETYPE, OMX_INDEXTYPE, OMX_PTR);
+        Vector<Default> mDefaults;
+        bool mNoReuse;
+    };
+
+    Mutex mLock;
     void *mLibHandle;
+    bool mLoadFailed;
+    Vector<Component> mComponents;
+
+    size_t mPoolSize;
+    Vector<Binding *> mActive;
+    Vector<Binding *> mIdle;
+
+    static NVOMXPlugin *sPlugin;
 
     typedef OMX_ERRORTYPE (*InitFunc)();
     typedef OMX_ERRORTYPE (*DeinitFunc)();
@@ -69,6 +111,37 @@ private:
     FreeHandleFunc mFreeHandle;
     GetRolesOfComponentFunc mGetRolesOfComponentHandle;
 
+    bool load();
+    bool loadLocked();
+    bool loadManifest();
+    void writeManifest() const;
+    void buildRegistry();
+    OMX_ERRORTYPE queryRoles(const char *name, Vector<String8> *roles);
+    const Component *findComponent(const char *name) const;
+
+    bool poolable(const char *name) const;
+    OMX_COMPONENTTYPE *takeIdle(const char *name,
+            const OMX_CALLBACKTYPE *callbacks, OMX_PTR appData);
+    OMX_ERRORTYPE makeBound(const char *name,
+            const OMX_CALLBACKTYPE *callbacks, OMX_PTR appData,
+            OMX_COMPONENTTYPE **component);
+    bool release(OMX_COMPONENTTYPE *component, OMX_ERRORTYPE *err);
+    static void saveDefault(Binding *binding, OMX_INDEXTYPE index,
+            OMX_PTR params);
+    static bool dropDefaults(Binding *binding, bool restore);
+
+    static OMX_ERRORTYPE OnEvent(
+            OMX_HANDLETYPE component, OMX_PTR appData, OMX_EVENTTYPE event,
+            OMX_U32 data1, OMX_U32 data2, OMX_PTR eventData);
+    static OMX_ERRORTYPE OnEmptyBufferDone(
+            OMX_HANDLETYPE component, OMX_PTR appData,
+            OMX_BUFFERHEADERTYPE *header);
+    static OMX_ERRORTYPE OnFillBufferDone(
+            OMX_HANDLETYPE component, OMX_PTR appData,
+            OMX_BUFFERHEADERTYPE *header);
+    static OMX_ERRORTYPE SetParameter(
+            OMX_HANDLETYPE component, OMX_INDEXTYPE index, OMX_PTR params);
+
     NVOMXPlugin(const NVOMXPlugin &);
     NVOMXPlugin &operator=(const NVOMXPlugin &);
 };
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NVOMXTrace.h"
+
+#define LOG_TAG "NVOMXTrace"
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cutils/properties.h>
+
+#define NVOMX_PROP_TRACE    "debug.nvomx.trace"
+#ifndef NVOMX_TRACE_FILE
+#define NVOMX_TRACE_FILE    "/data/misc/media/nvomx_trace.txt"
+#endif
+
+// Buffers in flight that can be matched to their completion while the ring
+// is summarised. Components never have more than a few dozen per port.
+#define NVOMX_TRACE_PENDING 64
+
+namespace android {
+
+NVOMXTrace::Slot NVOMXTrace::sSlots[NVOMXTrace::kMaxComponents];
+
+struct TraceStat {
+    uint32_t mCount;
+    int64_t mSumNs;
+    int64_t mMinNs;
+    int64_t mMaxNs;
+};
+
+struct TracePending {
+    bool mUsed;
+    uint64_t mKey;
+    int64_t mTimeNs;
+};
+
+static void stat_add(TraceStat *stat, int64_t ns) {
+    if (stat->mCount == 0 || ns < stat->mMinNs) {
+        stat->mMinNs = ns;
+    }
+    if (ns > stat->mMaxNs) {
+        stat->mMaxNs = ns;
+    }
+    stat->mSumNs += ns;
+    stat->mCount++;
+}
+
+static void pending_put(TracePending *pending, uint32_t *next,
+        uint64_t key, int64_t timeNs) {
+    for (uint32_t i = 0; i < NVOMX_TRACE_PENDING; ++i) {
+        if (pending[i].mUsed && pending[i].mKey == key) {
+            pending[i].mTimeNs = timeNs;
+            return;
+        }
+    }
+
+    // Unmatched entries (failed calls, flushed buffers) age out.
+    pending[*next].mUsed = true;
+    pending[*next].mKey = key;
+    pending[*next].mTimeNs = timeNs;
+    *next = (*next + 1) % NVOMX_TRACE_PENDING;
+}
+
+static bool pending_take(TracePending *pending, uint64_t key,
+        int64_t *timeNs) {
+    for (uint32_t i = 0; i < NVOMX_TRACE_PENDING; ++i) {
+        if (pending[i].mUsed && pending[i].mKey == key) {
+            *timeNs = pending[i].mTimeNs;
+            pending[i].mUsed = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void stat_print(FILE *fp, const char *what, const TraceStat &stat) {
+    if (stat.mCount == 0) {
+        fprintf(fp, "  %-16s n=0\n", what);
+        return;
+    }
+
+    fprintf(fp, "  %-16s n=%u avg=%.2fms min=%.2fms max=%.2fms\n", what,
+            stat.mCount, stat.mSumNs / 1e6 / stat.mCount,
+            stat.mMinNs / 1e6, stat.mMaxNs / 1e6);
+}
+
+static void max_update(int32_t *max, int32_t value) {
+    int32_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old && !__atomic_compare_exchange_n(max, &old, value,
+            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+bool NVOMXTrace::enabled() {
+    return property_get_bool(NVOMX_PROP_TRACE, false);
+}
+
+// The slot is claimed here rather than in attach(): once the component has
+// been given our callbacks the trace has to outlive it, so running out of
+// slots must be found out before OMX_GetHandle.
+NVOMXTrace *NVOMXTrace::create(
+        const char *name,
+        const OMX_CALLBACKTYPE *callbacks,
+        OMX_PTR appData) {
+    NVOMXTrace *trace = new NVOMXTrace(name, callbacks, appData);
+
+    for (size_t i = 0; i < kMaxComponents; ++i) {
+        NVOMXTrace *expected = NULL;
+
+        if (__atomic_compare_exchange_n(&sSlots[i].mTrace, &expected, trace,
+                false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            trace->mSlot = &sSlots[i];
+            return trace;
+        }
+    }
+
+    ALOGW("%s: too many traced components, not tracing", name);
+    delete trace;
+    return NULL;
+}
+
+NVOMXTrace::NVOMXTrace(
+        const char *name,
+        const OMX_CALLBACKTYPE *callbacks,
+        OMX_PTR appData)
+    : mName(name),
+      mCallbacks(*callbacks),
+      mAppData(appData),
+      mSlot(NULL),
+      mComponent(NULL),
+      mEmptyThisBuffer(NULL),
+      mFillThisBuffer(NULL),
+      mHead(0),
+      mInputQueued(0),
+      mOutputQueued(0),
+      mMaxInputQueued(0),
+      mMaxOutputQueued(0) {
+    mTracedCallbacks.EventHandler = OnEvent;
+    mTracedCallbacks.EmptyBufferDone = OnEmptyBufferDone;
+    mTracedCallbacks.FillBufferDone = OnFillBufferDone;
+}
+
+NVOMXTrace::~NVOMXTrace() {
+    if (mSlot != NULL) {
+        __atomic_store_n(&mSlot->mTrace, NULL, __ATOMIC_RELEASE);
+    }
+}
+
+bool NVOMXTrace::attach(OMX_COMPONENTTYPE *component) {
+    if (mSlot == NULL || mComponent != NULL) {
+        return false;
+    }
+
+    mComponent = component;
+    mEmptyThisBuffer = component->EmptyThisBuffer;
+    mFillThisBuffer = component->FillThisBuffer;
+    __atomic_store_n(&mSlot->mComponent, component, __ATOMIC_RELEASE);
+
+    component->EmptyThisBuffer = EmptyThisBuffer;
+    component->FillThisBuffer = FillThisBuffer;
+    return true;
+}
+
+// The entry points go back before the slot is cleared, so a queue call that
+// races with this and misses the lookup finds the original already in
+// place. The slot itself stays claimed until the trace is deleted.
+NVOMXTrace *NVOMXTrace::detach(OMX_COMPONENTTYPE *component) {
+    for (size_t i = 0; i < kMaxComponents; ++i) {
+        if (__atomic_load_n(&sSlots[i].mComponent, __ATOMIC_ACQUIRE) !=
+                component) {
+            continue;
+        }
+
+        NVOMXTrace *trace = sSlots[i].mTrace;
+        component->EmptyThisBuffer = trace->mEmptyThisBuffer;
+        component->FillThisBuffer = trace->mFillThisBuffer;
+
+        __atomic_store_n(&sSlots[i].mComponent, NULL, __ATOMIC_RELEASE);
+        return trace;
+    }
+
+    return NULL;
+}
+
+NVOMXTrace *NVOMXTrace::lookup(OMX_HANDLETYPE component) {
+    for (size_t i = 0; i < kMaxComponents; ++i) {
+        if (__atomic_load_n(&sSlots[i].mComponent, __ATOMIC_ACQUIRE) ==
+                component) {
+            return sSlots[i].mTrace;
+        }
+    }
+
+    return NULL;
+}
+
+void NVOMXTrace::record(EventType type, OMX_BUFFERHEADERTYPE *header) {
+    uint32_t index = __atomic_fetch_add(&mHead, 1, __ATOMIC_RELAXED);
+    Event *event = &mRing[index % kRingSize];
+
+    event->mTimeNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    event->mTimestamp = header->nTimeStamp;
+    event->mHeader = header;
+    event->mType = type;
+    event->mFilledLen = header->nFilledLen;
+}
+
+OMX_ERRORTYPE NVOMXTrace::EmptyThisBuffer(
+        OMX_HANDLETYPE component, OMX_BUFFERHEADERTYPE *header) {
+    NVOMXTrace *trace = lookup(component);
+
+    // Detached under us: the component's own entry point is back.
+    if (trace == NULL) {
+        return (*static_cast<OMX_COMPONENTTYPE *>(component)
+                ->EmptyThisBuffer)(component, header);
+    }
+
+    trace->record(EMPTY_THIS_BUFFER, header);
+    max_update(&trace->mMaxInputQueued,
+            __atomic_add_fetch(&trace->mInputQueued, 1, __ATOMIC_RELAXED));
+
+    OMX_ERRORTYPE err = (*trace->mEmptyThisBuffer)(component, header);
+    if (err != OMX_ErrorNone) {
+        __atomic_fetch_sub(&trace->mInputQueued, 1, __ATOMIC_RELAXED);
+    }
+    return err;
+}
+
+OMX_ERRORTYPE NVOMXTrace::FillThisBuffer(
+        OMX_HANDLETYPE component, OMX_BUFFERHEADERTYPE *header) {
+    NVOMXTrace *trace = lookup(component);
+
+    // Detached under us: the component's own entry point is back.
+    if (trace == NULL) {
+        return (*static_cast<OMX_COMPONENTTYPE *>(component)
+                ->FillThisBuffer)(component, header);
+    }
+
+    trace->record(FILL_THIS_BUFFER, header);
+    max_update(&trace->mMaxOutputQueued,
+            __atomic_add_fetch(&trace->mOutputQueued, 1, __ATOMIC_RELAXED));
+
+    OMX_ERRORTYPE err = (*trace->mFillThisBuffer)(component, header);
+    if (err != OMX_ErrorNone) {
+        __atomic_fetch_sub(&trace->mOutputQueued, 1, __ATOMIC_RELAXED);
+    }
+    return err;
+}
+
+OMX_ERRORTYPE NVOMXTrace::OnEvent(
+        OMX_HANDLETYPE component, OMX_PTR appData, OMX_EVENTTYPE event,
+        OMX_U32 data1, OMX_U32 data2, OMX_PTR eventData) {
+    NVOMXTrace *trace = static_cast<NVOMXTrace *>(appData);
+
+    return (*trace->mCallbacks.EventHandler)(
+            component, trace->mAppData, event, data1, data2, eventData);
+}
+
+OMX_ERRORTYPE NVOMXTrace::OnEmptyBufferDone(
+        OMX_HANDLETYPE component, OMX_PTR appData,
+        OMX_BUFFERHEADERTYPE *header) {
+    NVOMXTrace *trace = static_cast<NVOMXTrace *>(appData);
+
+    trace->record(EMPTY_BUFFER_DONE, header);
+    __atomic_fetch_sub(&trace->mInputQueued, 1, __ATOMIC_RELAXED);
+
+    return (*trace->mCallbacks.EmptyBufferDone)(
+            component, trace->mAppData, header);
+}
+
+OMX_ERRORTYPE NVOMXTrace::OnFillBufferDone(
+        OMX_HANDLETYPE component, OMX_PTR appData,
+        OMX_BUFFERHEADERTYPE *header) {
+    NVOMXTrace *trace = static_cast<NVOMXTrace *>(appData);
+
+    trace->record(FILL_BUFFER_DONE, header);
+    __atomic_fetch_sub(&trace->mOutputQueued, 1, __ATOMIC_RELAXED);
+
+    return (*trace->mCallbacks.FillBufferDone)(
+            component, trace->mAppData, header);
+}
+
+// Walks the ring oldest first and pairs each completion with the call that
+// queued the same header. Decode latency pairs an input with the first
+// output carrying its timestamp.
+void NVOMXTrace::dump() {
+    uint32_t head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+    uint32_t count = head < kRingSize ? head : kRingSize;
+
+    TracePending inputs[NVOMX_TRACE_PENDING];
+    TracePending outputs[NVOMX_TRACE_PENDING];
+    TracePending frames[NVOMX_TRACE_PENDING];
+    uint32_t nextInput = 0, nextOutput = 0, nextFrame = 0;
+    TraceStat input, output, decode;
+    uint64_t inputBytes = 0;
+    uint32_t outputFrames = 0;
+    int64_t firstNs = 0, lastNs = 0, firstFrameNs = 0, lastFrameNs = 0;
+
+    memset(inputs, 0, sizeof(inputs));
+    memset(outputs, 0, sizeof(outputs));
+    memset(frames, 0, sizeof(frames));
+    memset(&input, 0, sizeof(input));
+    memset(&output, 0, sizeof(output));
+    memset(&decode, 0, sizeof(decode));
+
+    for (uint32_t i = head - count; i != head; ++i) {
+        const Event &event = mRing[i % kRingSize];
+        uint64_t key = (uintptr_t)event.mHeader;
+        int64_t queuedNs;
+
+        if (i == head - count) {
+            firstNs = event.mTimeNs;
+        }
+        lastNs = event.mTimeNs;
+
+        switch (event.mType) {
+            case EMPTY_THIS_BUFFER:
+                inputBytes += event.mFilledLen;
+                pending_put(inputs, &nextInput, key, event.mTimeNs);
+                pending_put(frames, &nextFrame,
+                        (uint64_t)event.mTimestamp, event.mTimeNs);
+                break;
+
+            case EMPTY_BUFFER_DONE:
+                if (pending_take(inputs, key, &queuedNs)) {
+                    stat_add(&input, event.mTimeNs - queuedNs);
+                }
+                break;
+
+            case FILL_THIS_BUFFER:
+                pending_put(outputs, &nextOutput, key, event.mTimeNs);
+                break;
+
+            case FILL_BUFFER_DONE:
+                if (pending_take(outputs, key, &queuedNs)) {
+                    stat_add(&output, event.mTimeNs - queuedNs);
+                }
+                if (event.mFilledLen == 0) {
+                    break;
+                }
+                if (outputFrames++ == 0) {
+                    firstFrameNs = event.mTimeNs;
+                }
+                lastFrameNs = event.mTimeNs;
+                if (pending_take(frames, (uint64_t)event.mTimestamp,
+                        &queuedNs)) {
+                    stat_add(&decode, event.mTimeNs - queuedNs);
+                }
+                break;
+        }
+    }
+
+    double spanS = (lastNs - firstNs) / 1e9;
+    double fps = outputFrames > 1 && lastFrameNs > firstFrameNs
+            ? (outputFrames - 1) / ((lastFrameNs - firstFrameNs) / 1e9) : 0;
+
+    ALOGI("%s: %u frames, %.1f fps, decode avg %.2fms max %.2fms, "
+            "queue depth in %d out %d", mName.string(), outputFrames, fps,
+            decode.mCount ? decode.mSumNs / 1e6 / decode.mCount : 0,
+            decode.mMaxNs / 1e6, mMaxInputQueued, mMaxOutputQueued);
+
+    FILE *fp = fopen(NVOMX_TRACE_FILE, "a");
+    if (fp == NULL) {
+        return;
+    }
+
+    fprintf(fp, "%s: %u of %u events over %.3fs\n",
+            mName.string(), count, head, spanS);
+    stat_print(fp, "empty->done", input);
+    stat_print(fp, "fill->done", output);
+    stat_print(fp, "decode", decode);
+    fprintf(fp, "  %-16s in=%d out=%d\n", "max queued",
+            mMaxInputQueued, mMaxOutputQueued);
+    fprintf(fp, "  %-16s %u frames %.1f fps, %.1f kB/s in\n", "throughput",
+            outputFrames, fps, spanS > 0 ? inputBytes / 1024.0 / spanS : 0);
+    fclose(fp);
+}
+
+}  // namespace android
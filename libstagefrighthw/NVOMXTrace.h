@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_OMX_TRACE_H_
+
+#define NV_OMX_TRACE_H_
+
+#include <media/hardware/OMXPluginBase.h>
+#include <utils/String8.h>
+
+namespace android {
+
+// Optional buffer-flow tracer for NV components, enabled with
+// debug.nvomx.trace. It sits between Stagefright and the component:
+// EmptyThisBuffer/FillThisBuffer and the matching *BufferDone callbacks
+// are timestamped into a ring and passed through with the same buffer
+// headers. The summary is appended to NVOMX_TRACE_FILE when the component
+// is destroyed.
+struct NVOMXTrace {
+    static bool enabled();
+
+    // Returns NULL when kMaxComponents traces are already live, in which
+    // case the component is made untraced.
+    static NVOMXTrace *create(
+            const char *name,
+            const OMX_CALLBACKTYPE *callbacks,
+            OMX_PTR appData);
+
+    // Callbacks and appData to hand to OMX_GetHandle instead of the
+    // client's own.
+    OMX_CALLBACKTYPE *callbacks() { return &mTracedCallbacks; }
+    OMX_PTR appData() { return this; }
+
+    // detach() puts the component's own entry points back, so it must run
+    // while the component is still alive. The callbacks keep forwarding
+    // until the trace is deleted. attach() fails if the trace is already
+    // attached; the caller then owns the trace and deletes it.
+    bool attach(OMX_COMPONENTTYPE *component);
+    static NVOMXTrace *detach(OMX_COMPONENTTYPE *component);
+
+    void dump();
+
+    ~NVOMXTrace();
+
+private:
+    enum {
+        kRingSize = 2048,
+        kMaxComponents = 16,
+    };
+
+    enum EventType {
+        EMPTY_THIS_BUFFER,
+        EMPTY_BUFFER_DONE,
+        FILL_THIS_BUFFER,
+        FILL_BUFFER_DONE,
+    };
+
+    struct Event {
+        int64_t mTimeNs;
+        OMX_TICKS mTimestamp;
+        OMX_BUFFERHEADERTYPE *mHeader;
+        uint32_t mType;
+        uint32_t mFilledLen;
+    };
+
+    struct Slot {
+        OMX_COMPONENTTYPE *mComponent;
+        NVOMXTrace *mTrace;
+    };
+
+    String8 mName;
+    OMX_CALLBACKTYPE mCallbacks;
+    OMX_PTR mAppData;
+    OMX_CALLBACKTYPE mTracedCallbacks;
+
+    Slot *mSlot;
+    OMX_COMPONENTTYPE *mComponent;
+    OMX_ERRORTYPE (*mEmptyThisBuffer)(
+            OMX_HANDLETYPE, OMX_BUFFERHEADERTYPE *);
+    OMX_ERRORTYPE (*mFillThisBuffer)(
+            OMX_HANDLETYPE, OMX_BUFFERHEADERTYPE *);
+
+    uint32_t mHead;
+    int32_t mInputQueued;
+    int32_t mOutputQueued;
+    int32_t mMaxInputQueued;
+    int32_t mMaxOutputQueued;
+    Event mRing[kRingSize];
+
+    static Slot sSlots[kMaxComponents];
+
+    NVOMXTrace(const char *name, const OMX_CALLBACKTYPE *callbacks,
+            OMX_PTR appData);
+
+    void record(EventType type, OMX_BUFFERHEADERTYPE *header);
+    static NVOMXTrace *lookup(OMX_HANDLETYPE component);
+
+    static OMX_ERRORTYPE EmptyThisBuffer(
+            OMX_HANDLETYPE component, OMX_BUFFERHEADERTYPE *header);
+    static OMX_ERRORTYPE FillThisBuffer(
+            OMX_HANDLETYPE component, OMX_BUFFERHEADERTYPE *header);
+
+    static OMX_ERRORTYPE OnEvent(
+            OMX_HANDLETYPE component, OMX_PTR appData, OMX_EVENTTYPE event,
+            OMX_U32 data1, OMX_U32 data2, OMX_PTR eventData);
+    static OMX_ERRORTYPE OnEmptyBufferDone(
+            OMX_HANDLETYPE component, OMX_PTR appData,
+            OMX_BUFFERHEADERTYPE *header);
+    static OMX_ERRORTYPE OnFillBufferDone(
+            OMX_HANDLETYPE component, OMX_PTR appData,
+            OMX_BUFFERHEADERTYPE *header);
+
+    NVOMXTrace(const NVOMXTrace &);
+    NVOMXTrace &operator=(const NVOMXTrace &);
+};
+
+}  // namespace android
+
+#endif  // NV_OMX_TRACE_H_
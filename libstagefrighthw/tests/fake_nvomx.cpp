@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for libnvomx.so. Components answer state changes and
+// buffer calls synchronously from the calling thread, and keep whatever
+// parameters they are given so a test can tell a reused instance apart
+// from a fresh one.
+
+#include "fake_nvomx.h"
+
+#include <OMX_Component.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FAKE_MAX_ROLES      4
+#define FAKE_MAX_PARAMS     16
+#define FAKE_PARAM_SIZE     64
+
+struct FakeInfo {
+    const char *mName;
+    const char *mRoles[FAKE_MAX_ROLES];
+};
+
+static const FakeInfo kComponents[] = {
+    { "OMX.Nvidia.h264.decode", { "video_decoder.avc" } },
+    { "OMX.Nvidia.mp4.decode",
+            { "video_decoder.mpeg4", "video_decoder.h263" } },
+    { "OMX.Nvidia.vc1.decode", { "video_decoder.vc1", "video_decoder.wmv" } },
+    { "OMX.Nvidia.mp3.decoder",
+            { "audio_decoder.mp3", "audio_decoder.mp2", "audio_decoder.mp1" } },
+    { "OMX.Nvidia.jpeg.decoder", { "image_decoder.jpeg" } },
+    { "OMX.Nvidia.h264.encoder", { "video_encoder.avc" } },
+    { "OMX.Nvidia.drm.play", { NULL } },
+};
+
+#define FAKE_NUM_COMPONENTS (sizeof(kComponents) / sizeof(kComponents[0]))
+
+struct FakeParam {
+    OMX_INDEXTYPE mIndex;
+    OMX_U32 mPort;
+    OMX_U32 mSize;
+    OMX_U8 mData[FAKE_PARAM_SIZE];
+};
+
+struct FakeComponent {
+    OMX_COMPONENTTYPE mBase;
+    const FakeInfo *mInfo;
+    OMX_CALLBACKTYPE mCallbacks;
+    OMX_PTR mAppData;
+    OMX_STATETYPE mState;
+    OMX_TICKS mLastTimestamp;
+    size_t mNumParams;
+    FakeParam mParams[FAKE_MAX_PARAMS];
+};
+
+static unsigned sLatencyUs[NVOMX_FAKE_NUM_CALLS];
+static OMX_ERRORTYPE sError[NVOMX_FAKE_NUM_CALLS];
+static unsigned sErrorNth[NVOMX_FAKE_NUM_CALLS];
+static nvomx_fake_stats sStats;
+
+static int64_t now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Spins rather than sleeps so short latencies are not rounded up to the
+// scheduler tick.
+static OMX_ERRORTYPE fake_enter(int call) {
+    unsigned count = ++sStats.calls[call];
+
+    if (sLatencyUs[call] > 0) {
+        int64_t end = now_ns() + sLatencyUs[call] * 1000LL;
+        while (now_ns() < end) {
+        }
+    }
+
+    if (sErrorNth[call] > 0 && count % sErrorNth[call] == 0) {
+        ++sStats.errors[call];
+        return sError[call];
+    }
+    return OMX_ErrorNone;
+}
+
+static const FakeInfo *fake_find(const char *name) {
+    for (size_t i = 0; i < FAKE_NUM_COMPONENTS; ++i) {
+        if (!strcmp(kComponents[i].mName, name)) {
+            return &kComponents[i];
+        }
+    }
+    return NULL;
+}
+
+// Parameters are keyed by index and the field after the OMX header, which
+// is the port index for most of them. Anything never set reads back as
+// zeroes after that key.
+static FakeParam *fake_param(FakeComponent *component, OMX_INDEXTYPE index,
+        OMX_PTR params, bool create) {
+    OMX_U32 *header = static_cast<OMX_U32 *>(params);
+    OMX_U32 port = header[0] >= 3 * sizeof(OMX_U32) ? header[2] : 0;
+
+    for (size_t i = 0; i < component->mNumParams; ++i) {
+        FakeParam *param = &component->mParams[i];
+        if (param->mIndex == index && param->mPort == port) {
+            return param;
+        }
+    }
+
+    if (!create || component->mNumParams == FAKE_MAX_PARAMS) {
+        return NULL;
+    }
+
+    FakeParam *param = &component->mParams[component->mNumParams++];
+    param->mIndex = index;
+    param->mPort = port;
+    param->mSize = 0;
+    return param;
+}
+
+static OMX_ERRORTYPE FakeGetParameter(
+        OMX_HANDLETYPE handle, OMX_INDEXTYPE index, OMX_PTR params) {
+    FakeComponent *component = static_cast<FakeComponent *>(handle);
+    OMX_U32 size = *static_cast<OMX_U32 *>(params);
+
+    if (size < 2 * sizeof(OMX_U32) || size > FAKE_PARAM_SIZE) {
+        return OMX_ErrorBadParameter;
+    }
+
+    FakeParam *param = fake_param(component, index, params, false);
+    OMX_U32 keep = size < 3 * sizeof(OMX_U32) ? size : 3 * sizeof(OMX_U32);
+
+    memset(static_cast<OMX_U8 *>(params) + keep, 0, size - keep);
+    if (param != NULL) {
+        memcpy(params, param->mData, size < param->mSize ? size : param->mSize);
+    }
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE FakeSetParameter(
+        OMX_HANDLETYPE handle, OMX_INDEXTYPE index, OMX_PTR params) {
+    FakeComponent *component = static_cast<FakeComponent *>(handle);
+    OMX_U32 size = *static_cast<OMX_U32 *>(params);
+
+    if (size < 2 * sizeof(OMX_U32) || size > FAKE_PARAM_SIZE) {
+        return OMX_ErrorBadParameter;
+    }
+
+    if (component->mState != OMX_StateLoaded &&
+            index < OMX_IndexVendorStartUnused) {
+        return OMX_ErrorIncorrectStateOperation;
+    }
+
+    FakeParam *param = fake_param(component, index, params, true);
+    if (param == NULL) {
+        return OMX_ErrorInsufficientResources;
+    }
+
+    memcpy(param->mData, params, size);
+    param->mSize = size;
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE FakeGetState(
+        OMX_HANDLETYPE handle, OMX_STATETYPE *state) {
+    *state = static_cast<FakeComponent *>(handle)->mState;
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE FakeSendCommand(
+        OMX_HANDLETYPE handle, OMX_COMMANDTYPE command, OMX_U32 param,
+        OMX_PTR data) {
+    FakeComponent *component = static_cast<FakeComponent *>(handle);
+
+    if (command != OMX_CommandStateSet) {
+        return OMX_ErrorNotImplemented;
+    }
+
+    component->mState = static_cast<OMX_STATETYPE>(param);
+    if (component->mCallbacks.EventHandler != NULL) {
+        (*component->mCallbacks.EventHandler)(handle, component->mAppData,
+                OMX_EventCmdComplete, command, param, data);
+    }
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE FakeEmptyThisBuffer(
+        OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE *header) {
+    FakeComponent *component = static_cast<FakeComponent *>(handle);
+
+    if (component->mState != OMX_StateExecuting) {
+        return OMX_ErrorIncorrectStateOperation;
+    }
+
+    component->mLastTimestamp = header->nTimeStamp;
+    return (*component->mCallbacks.EmptyBufferDone)(
+            handle, component->mAppData, header);
+}
+
+static OMX_ERRORTYPE FakeFillThisBuffer(
+        OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE *header) {
+    FakeComponent *component = static_cast<FakeComponent *>(handle);
+
+    if (component->mState != OMX_StateExecuting) {
+        return OMX_ErrorIncorrectStateOperation;
+    }
+
+    header->nTimeStamp = component->mLastTimestamp;
+    header->nFilledLen = header->nAllocLen;
+    return (*component->mCallbacks.FillBufferDone)(
+            handle, component->mAppData, header);
+}
+
+extern "C" {
+
+OMX_ERRORTYPE OMX_Init() {
+    return fake_enter(NVOMX_FAKE_INIT);
+}
+
+OMX_ERRORTYPE OMX_Deinit() {
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE OMX_ComponentNameEnum(
+        OMX_STRING name, OMX_U32 size, OMX_U32 index) {
+    OMX_ERRORTYPE err = fake_enter(NVOMX_FAKE_NAME_ENUM);
+
+    if (err != OMX_ErrorNone) {
+        return err;
+    }
+
+    if (index >= FAKE_NUM_COMPONENTS) {
+        return OMX_ErrorNoMore;
+    }
+
+    if (strlen(kComponents[index].mName) >= size) {
+        return OMX_ErrorBadParameter;
+    }
+
+    strcpy(name, kComponents[index].mName);
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE OMX_GetHandle(
+        OMX_HANDLETYPE *handle, OMX_STRING name, OMX_PTR appData,
+        OMX_CALLBACKTYPE *callbacks) {
+    OMX_ERRORTYPE err = fake_enter(NVOMX_FAKE_GET_HANDLE);
+
+    if (err != OMX_ErrorNone) {
+        return err;
+    }
+
+    const FakeInfo *info = fake_find(name);
+    if (info == NULL) {
+        return OMX_ErrorComponentNotFound;
+    }
+
+    FakeComponent *component =
+            static_cast<FakeComponent *>(calloc(1, sizeof(FakeComponent)));
+    if (component == NULL) {
+        return OMX_ErrorInsufficientResources;
+    }
+
+    component->mBase.nSize = sizeof(component->mBase);
+    component->mBase.pComponentPrivate = component;
+    component->mBase.pApplicationPrivate = appData;
+    component->mBase.SendCommand = FakeSendCommand;
+    component->mBase.GetParameter = FakeGetParameter;
+    component->mBase.SetParameter = FakeSetParameter;
+    component->mBase.GetState = FakeGetState;
+    component->mBase.EmptyThisBuffer = FakeEmptyThisBuffer;
+    component->mBase.FillThisBuffer = FakeFillThisBuffer;
+    component->mInfo = info;
+    component->mCallbacks = *callbacks;
+    component->mAppData = appData;
+    component->mState = OMX_StateLoaded;
+
+    ++sStats.live_handles;
+    *handle = &component->mBase;
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE OMX_FreeHandle(OMX_HANDLETYPE handle) {
+    OMX_ERRORTYPE err = fake_enter(NVOMX_FAKE_FREE_HANDLE);
+
+    if (err != OMX_ErrorNone) {
+        return err;
+    }
+
+    --sStats.live_handles;
+    free(handle);
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE OMX_GetRolesOfComponent(
+        OMX_STRING name, OMX_U32 *numRoles, OMX_U8 **roles) {
+    OMX_ERRORTYPE err = fake_enter(NVOMX_FAKE_GET_ROLES);
+
+    if (err != OMX_ErrorNone) {
+        return err;
+    }
+
+    const FakeInfo *info = fake_find(name);
+    if (info == NULL) {
+        return OMX_ErrorInvalidComponentName;
+    }
+
+    OMX_U32 count = 0;
+    while (count < FAKE_MAX_ROLES && info->mRoles[count] != NULL) {
+        ++count;
+    }
+
+    if (roles != NULL) {
+        if (*numRoles < count) {
+            return OMX_ErrorBadParameter;
+        }
+        for (OMX_U32 i = 0; i < count; ++i) {
+            strcpy(reinterpret_cast<char *>(roles[i]), info->mRoles[i]);
+        }
+    }
+
+    *numRoles = count;
+    return OMX_ErrorNone;
+}
+
+void nvomx_fake_set_latency(int call, unsigned us) {
+    sLatencyUs[call] = us;
+}
+
+void nvomx_fake_set_error(int call, OMX_ERRORTYPE err, unsigned nth) {
+    sError[call] = err;
+    sErrorNth[call] = err != OMX_ErrorNone ? nth : 0;
+}
+
+void nvomx_fake_reset(void) {
+    int live = sStats.live_handles;
+
+    memset(sLatencyUs, 0, sizeof(sLatencyUs));
+    memset(sErrorNth, 0, sizeof(sErrorNth));
+    memset(&sStats, 0, sizeof(sStats));
+    sStats.live_handles = live;
+}
+
+void nvomx_fake_get_stats(struct nvomx_fake_stats *stats) {
+    *stats = sStats;
+}
+
+const char *nvomx_fake_component(unsigned index) {
+    return index < FAKE_NUM_COMPONENTS ? kComponents[index].mName : NULL;
+}
+
+const char *nvomx_fake_role(const char *component, unsigned index) {
+    const FakeInfo *info = fake_find(component);
+
+    if (info == NULL || index >= FAKE_MAX_ROLES) {
+        return NULL;
+    }
+    return info->mRoles[index];
+}
+
+}  // extern "C"
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKE_NVOMX_H_
+
+#define FAKE_NVOMX_H_
+
+#include <OMX_Core.h>
+
+// Controls for the host stand-in for libnvomx.so. The fake exports the
+// OMX IL core entry points the plugin looks up, plus these.
+
+enum {
+    NVOMX_FAKE_INIT,
+    NVOMX_FAKE_NAME_ENUM,
+    NVOMX_FAKE_GET_HANDLE,
+    NVOMX_FAKE_FREE_HANDLE,
+    NVOMX_FAKE_GET_ROLES,
+    NVOMX_FAKE_NUM_CALLS,
+};
+
+struct nvomx_fake_stats {
+    unsigned calls[NVOMX_FAKE_NUM_CALLS];
+    unsigned errors[NVOMX_FAKE_NUM_CALLS];
+    int live_handles;
+};
+
+extern "C" {
+
+// Every call to the entry point spins for us microseconds first.
+void nvomx_fake_set_latency(int call, unsigned us);
+
+// Every nth call to the entry point fails with err, 1 fails them all and
+// OMX_ErrorNone or 0 turns injection off.
+void nvomx_fake_set_error(int call, OMX_ERRORTYPE err, unsigned nth);
+
+// Drops latencies, errors and counters; live handles are kept.
+void nvomx_fake_reset(void);
+
+void nvomx_fake_get_stats(struct nvomx_fake_stats *stats);
+
+// Names and roles the fake reports, NULL terminated.
+const char *nvomx_fake_component(unsigned index);
+const char *nvomx_fake_role(const char *component, unsigned index);
+
+}
+
+#endif  // FAKE_NVOMX_H_
@@ -0,0 +1,562 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test and benchmark for NVOMXPlugin against the fake libnvomx in
+ * fake_nvomx.cpp. The plugin is built into this executable with NVOMX_LIB
+ * taken from the environment, which is pointed at the copy of the fake
+ * this executable is linked against, so both see the same counters.
+ *
+ *   nvomx_test [cycles] [get_handle_us] [free_handle_us]
+ *
+ * The checks cover enumeration, roles, making and destroying instances and
+ * reuse of pooled decoders, including the heap: a registry query must not
+ * leak, and neither must a registry built while libnvomx fails role
+ * queries. The benchmarks then time plugin startup and the codec list
+ * queries against a slow libnvomx, and time-to-first-frame of a decoder
+ * with and without the pool. The default latencies are placeholders of
+ * about the right size, not measurements from a device.
+ */
+
+#include <media/hardware/OMXPluginBase.h>
+#include <cutils/properties.h>
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_nvomx.h"
+
+namespace android {
+OMXPluginBase *createOMXPlugin();
+}
+
+using namespace android;
+
+#define TEST_COMPONENT      "OMX.Nvidia.h264.decode"
+#define TEST_FRAME_BYTES    4096
+
+static int sFailures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, \
+                    #cond); \
+            ++sFailures; \
+        } \
+    } while (0)
+
+/* -- heap accounting, glibc only */
+
+struct AllocCount {
+    unsigned mCalls;
+    int mLive;
+};
+
+static AllocCount sAllocs;
+
+#ifdef __GLIBC__
+#define HAVE_ALLOC_COUNT 1
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t align, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    if (ptr != NULL) {
+        ++sAllocs.mCalls;
+        ++sAllocs.mLive;
+    }
+    return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+    void *ptr = __libc_calloc(count, size);
+    if (ptr != NULL) {
+        ++sAllocs.mCalls;
+        ++sAllocs.mLive;
+    }
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    ++sAllocs.mCalls;
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t align, size_t size) {
+    void *ptr = __libc_memalign(align, size);
+    if (ptr != NULL) {
+        ++sAllocs.mCalls;
+        ++sAllocs.mLive;
+    }
+    return ptr;
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+    *out = memalign(align, size);
+    return *out != NULL ? 0 : 12;   // ENOMEM
+}
+
+void free(void *ptr) {
+    if (ptr != NULL) {
+        --sAllocs.mLive;
+    }
+    __libc_free(ptr);
+}
+}
+#else
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+/* -- helpers */
+
+static int64_t now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned fake_calls(int call) {
+    nvomx_fake_stats stats;
+
+    nvomx_fake_get_stats(&stats);
+    return stats.calls[call];
+}
+
+static int fake_live_handles() {
+    nvomx_fake_stats stats;
+
+    nvomx_fake_get_stats(&stats);
+    return stats.live_handles;
+}
+
+static OMXPluginBase *new_plugin(bool lazy, int poolSize) {
+    char value[PROPERTY_VALUE_MAX];
+
+    snprintf(value, sizeof(value), "%d", poolSize);
+    property_set("ro.nvomx.pool_size", value);
+    property_set("ro.nvomx.lazy", lazy ? "1" : "0");
+    return createOMXPlugin();
+}
+
+struct Client {
+    unsigned mEvents;
+    unsigned mEmptyDone;
+    unsigned mFillDone;
+    int64_t mFirstFrameNs;
+    OMX_COMPONENTTYPE *mComponent;
+};
+
+static OMX_ERRORTYPE client_event(
+        OMX_HANDLETYPE, OMX_PTR appData, OMX_EVENTTYPE, OMX_U32, OMX_U32,
+        OMX_PTR) {
+    ++static_cast<Client *>(appData)->mEvents;
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE client_empty_done(
+        OMX_HANDLETYPE, OMX_PTR appData, OMX_BUFFERHEADERTYPE *) {
+    ++static_cast<Client *>(appData)->mEmptyDone;
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE client_fill_done(
+        OMX_HANDLETYPE, OMX_PTR appData, OMX_BUFFERHEADERTYPE *header) {
+    Client *client = static_cast<Client *>(appData);
+
+    if (client->mFillDone++ == 0 && header->nFilledLen > 0) {
+        client->mFirstFrameNs = now_ns();
+    }
+    return OMX_ErrorNone;
+}
+
+static OMX_CALLBACKTYPE sClientCallbacks = {
+    client_event, client_empty_done, client_fill_done,
+};
+
+static OMX_ERRORTYPE client_make(OMXPluginBase *plugin, const char *name,
+        Client *client) {
+    memset(client, 0, sizeof(*client));
+    return plugin->makeComponentInstance(
+            name, &sClientCallbacks, client, &client->mComponent);
+}
+
+static void client_set_state(Client *client, OMX_STATETYPE state) {
+    OMX_COMPONENTTYPE *component = client->mComponent;
+
+    (*component->SendCommand)(component, OMX_CommandStateSet, state, NULL);
+}
+
+// Idle, Executing, one buffer each way, then back to Loaded.
+static void client_decode_one(Client *client) {
+    OMX_COMPONENTTYPE *component = client->mComponent;
+    OMX_BUFFERHEADERTYPE input, output;
+
+    memset(&input, 0, sizeof(input));
+    memset(&output, 0, sizeof(output));
+    input.nFilledLen = 100;
+    input.nTimeStamp = 33333;
+    output.nAllocLen = TEST_FRAME_BYTES;
+
+    client_set_state(client, OMX_StateIdle);
+    client_set_state(client, OMX_StateExecuting);
+    (*component->EmptyThisBuffer)(component, &input);
+    (*component->FillThisBuffer)(component, &output);
+    client_set_state(client, OMX_StateIdle);
+    client_set_state(client, OMX_StateLoaded);
+}
+
+static void port_format(OMX_VIDEO_PARAM_PORTFORMATTYPE *format,
+        OMX_COLOR_FORMATTYPE color) {
+    memset(format, 0, sizeof(*format));
+    format->nSize = sizeof(*format);
+    format->nPortIndex = 1;
+    format->eColorFormat = color;
+}
+
+/* -- checks */
+
+static void test_registry() {
+    nvomx_fake_reset();
+    OMXPluginBase *plugin = new_plugin(false, 0);
+    char name[OMX_MAX_STRINGNAME_SIZE];
+    OMX_U32 index;
+
+    for (index = 0; nvomx_fake_component(index) != NULL; ++index) {
+        CHECK(plugin->enumerateComponents(name, sizeof(name), index) ==
+                OMX_ErrorNone);
+        CHECK(!strcmp(name, nvomx_fake_component(index)));
+
+        Vector<String8> roles;
+        CHECK(plugin->getRolesOfComponent(name, &roles) == OMX_ErrorNone);
+
+        size_t count = 0;
+        while (nvomx_fake_role(name, count) != NULL) {
+            ++count;
+        }
+        CHECK(roles.size() == count);
+        for (size_t i = 0; i < roles.size() && i < count; ++i) {
+            CHECK(!strcmp(roles[i].string(), nvomx_fake_role(name, i)));
+        }
+    }
+    CHECK(plugin->enumerateComponents(name, sizeof(name), index) ==
+            OMX_ErrorNoMore);
+    CHECK(plugin->enumerateComponents(name, 4, 0) == OMX_ErrorBadParameter);
+
+    Vector<String8> roles;
+    CHECK(plugin->getRolesOfComponent("OMX.Nvidia.none", &roles) ==
+            OMX_ErrorInvalidComponentName);
+
+    // Everything above came from the registry.
+    unsigned enums = fake_calls(NVOMX_FAKE_NAME_ENUM);
+    unsigned queries = fake_calls(NVOMX_FAKE_GET_ROLES);
+
+    AllocCount before = sAllocs;
+    for (int round = 0; round < 100; ++round) {
+        Vector<String8> queried;
+
+        for (index = 0; plugin->enumerateComponents(
+                name, sizeof(name), index) == OMX_ErrorNone; ++index) {
+            plugin->getRolesOfComponent(name, &queried);
+        }
+    }
+
+    CHECK(fake_calls(NVOMX_FAKE_NAME_ENUM) == enums);
+    CHECK(fake_calls(NVOMX_FAKE_GET_ROLES) == queries);
+    CHECK(sAllocs.mLive == before.mLive);
+
+    printf("registry: %u components, %.2f allocations per roles query\n",
+            index, (sAllocs.mCalls - before.mCalls) / (100.0 * index));
+
+    delete plugin;
+}
+
+// The roles arrays handed to OMX_GetRolesOfComponent used to leak when it
+// failed. Every second call fails here, which is the one filling the
+// arrays for each component that has roles.
+static void test_roles_leak() {
+    nvomx_fake_reset();
+    nvomx_fake_set_error(NVOMX_FAKE_GET_ROLES, OMX_ErrorInsufficientResources,
+            2);
+
+    // The first cycle pays for one-time allocations in dlopen.
+    delete new_plugin(false, 0);
+
+    AllocCount before = sAllocs;
+    for (int cycle = 0; cycle < 5; ++cycle) {
+        OMXPluginBase *plugin = new_plugin(false, 0);
+        Vector<String8> roles;
+
+        CHECK(plugin->getRolesOfComponent(TEST_COMPONENT, &roles) ==
+                OMX_ErrorInsufficientResources);
+        CHECK(roles.isEmpty());
+        delete plugin;
+    }
+
+    nvomx_fake_stats stats;
+    nvomx_fake_get_stats(&stats);
+    CHECK(stats.errors[NVOMX_FAKE_GET_ROLES] > 0);
+    if (HAVE_ALLOC_COUNT) {
+        CHECK(sAllocs.mLive == before.mLive);
+    }
+
+    printf("roles errors: %u failed queries, %d blocks leaked\n",
+            stats.errors[NVOMX_FAKE_GET_ROLES], sAllocs.mLive - before.mLive);
+}
+
+static void test_instances() {
+    nvomx_fake_reset();
+    OMXPluginBase *plugin = new_plugin(false, 0);
+    Client client;
+
+    for (unsigned i = 0; nvomx_fake_component(i) != NULL; ++i) {
+        CHECK(client_make(plugin, nvomx_fake_component(i), &client) ==
+                OMX_ErrorNone);
+        CHECK(fake_live_handles() == 1);
+        CHECK(plugin->destroyComponentInstance(client.mComponent) ==
+                OMX_ErrorNone);
+        CHECK(fake_live_handles() == 0);
+    }
+
+    nvomx_fake_set_error(NVOMX_FAKE_GET_HANDLE,
+            OMX_ErrorInsufficientResources, 1);
+    AllocCount before = sAllocs;
+    CHECK(client_make(plugin, TEST_COMPONENT, &client) ==
+            OMX_ErrorInsufficientResources);
+    CHECK(fake_live_handles() == 0);
+    CHECK(sAllocs.mLive == before.mLive);
+    nvomx_fake_set_error(NVOMX_FAKE_GET_HANDLE, OMX_ErrorNone, 0);
+
+    delete plugin;
+}
+
+static void test_pool() {
+    nvomx_fake_reset();
+    OMXPluginBase *plugin = new_plugin(false, 1);
+    OMX_VIDEO_PARAM_PORTFORMATTYPE format;
+    Client first, second;
+
+    // The first client changes a standard parameter and finishes cleanly.
+    CHECK(client_make(plugin, TEST_COMPONENT, &first) == OMX_ErrorNone);
+    port_format(&format, OMX_COLOR_FormatYUV420Planar);
+    CHECK((*first.mComponent->SetParameter)(first.mComponent,
+            OMX_IndexParamVideoPortFormat, &format) == OMX_ErrorNone);
+    client_decode_one(&first);
+    CHECK(plugin->destroyComponentInstance(first.mComponent) ==
+            OMX_ErrorNone);
+    CHECK(fake_live_handles() == 1);
+
+    // The second gets the same instance, its own callbacks and the
+    // parameter as it was before the first client set it.
+    CHECK(client_make(plugin, TEST_COMPONENT, &second) == OMX_ErrorNone);
+    CHECK(second.mComponent == first.mComponent);
+    CHECK(fake_calls(NVOMX_FAKE_GET_HANDLE) == 1);
+
+    port_format(&format, OMX_COLOR_FormatUnused);
+    CHECK((*second.mComponent->GetParameter)(second.mComponent,
+            OMX_IndexParamVideoPortFormat, &format) == OMX_ErrorNone);
+    CHECK(format.eColorFormat == OMX_COLOR_FormatUnused);
+
+    unsigned events = first.mEvents;
+    client_decode_one(&second);
+    CHECK(first.mEvents == events);
+    CHECK(second.mEvents == 4 && second.mEmptyDone == 1 &&
+            second.mFillDone == 1);
+
+    // Vendor parameters cannot be put back, so that instance is freed.
+    OMX_U32 vendor[4] = { sizeof(vendor), 0, 0, 1 };
+    (*second.mComponent->SetParameter)(second.mComponent,
+            OMX_IndexVendorStartUnused, vendor);
+    CHECK(plugin->destroyComponentInstance(second.mComponent) ==
+            OMX_ErrorNone);
+    CHECK(fake_live_handles() == 0);
+
+    // As is one destroyed outside Loaded.
+    CHECK(client_make(plugin, TEST_COMPONENT, &first) == OMX_ErrorNone);
+    client_set_state(&first, OMX_StateIdle);
+    CHECK(plugin->destroyComponentInstance(first.mComponent) ==
+            OMX_ErrorNone);
+    CHECK(fake_live_handles() == 0);
+
+    // Encoders are never pooled.
+    CHECK(client_make(plugin, "OMX.Nvidia.h264.encoder", &first) ==
+            OMX_ErrorNone);
+    CHECK(plugin->destroyComponentInstance(first.mComponent) ==
+            OMX_ErrorNone);
+    CHECK(fake_live_handles() == 0);
+
+    CHECK(client_make(plugin, TEST_COMPONENT, &first) == OMX_ErrorNone);
+    CHECK(plugin->destroyComponentInstance(first.mComponent) ==
+            OMX_ErrorNone);
+    CHECK(fake_live_handles() == 1);
+    delete plugin;
+    CHECK(fake_live_handles() == 0);
+}
+
+static void test_trace() {
+    nvomx_fake_reset();
+    property_set("debug.nvomx.trace", "1");
+    OMXPluginBase *plugin = new_plugin(false, 1);
+    Client client;
+
+    for (int i = 0; i < 2; ++i) {
+        CHECK(client_make(plugin, TEST_COMPONENT, &client) == OMX_ErrorNone);
+        client_decode_one(&client);
+        CHECK(client.mEmptyDone == 1 && client.mFillDone == 1);
+        CHECK(plugin->destroyComponentInstance(client.mComponent) ==
+                OMX_ErrorNone);
+    }
+
+    delete plugin;
+    property_set("debug.nvomx.trace", "0");
+    CHECK(fake_live_handles() == 0);
+}
+
+/* -- benchmarks */
+
+static void bench_startup() {
+    char name[OMX_MAX_STRINGNAME_SIZE];
+    Vector<String8> roles;
+
+    nvomx_fake_reset();
+    nvomx_fake_set_latency(NVOMX_FAKE_INIT, 20000);
+    nvomx_fake_set_latency(NVOMX_FAKE_NAME_ENUM, 200);
+    nvomx_fake_set_latency(NVOMX_FAKE_GET_ROLES, 200);
+    unlink(NVOMX_MANIFEST);
+
+    for (int pass = 0; pass < 3; ++pass) {
+        static const char *kPasses[] = {
+            "eager", "lazy, no manifest", "lazy, manifest",
+        };
+        unsigned calls = fake_calls(NVOMX_FAKE_INIT) +
+                fake_calls(NVOMX_FAKE_NAME_ENUM) +
+                fake_calls(NVOMX_FAKE_GET_ROLES);
+
+        int64_t start = now_ns();
+        OMXPluginBase *plugin = new_plugin(pass > 0, 0);
+        int64_t created = now_ns();
+
+        // What building MediaCodecList asks for, ten times over.
+        unsigned queries = 0;
+        for (int round = 0; round < 10; ++round) {
+            for (OMX_U32 index = 0; plugin->enumerateComponents(
+                    name, sizeof(name), index) == OMX_ErrorNone; ++index) {
+                plugin->getRolesOfComponent(name, &roles);
+                ++queries;
+            }
+        }
+        int64_t done = now_ns();
+
+        calls = fake_calls(NVOMX_FAKE_INIT) +
+                fake_calls(NVOMX_FAKE_NAME_ENUM) +
+                fake_calls(NVOMX_FAKE_GET_ROLES) - calls;
+        printf("startup %-18s: create %.2fms, %u queries %.3fms, "
+                "%u libnvomx calls\n", kPasses[pass],
+                (created - start) / 1e6, queries, (done - created) / 1e6,
+                calls);
+        delete plugin;
+    }
+
+    unlink(NVOMX_MANIFEST);
+}
+
+static void bench_first_frame(int cycles, unsigned getUs, unsigned freeUs) {
+    for (int poolSize = 0; poolSize <= 1; ++poolSize) {
+        nvomx_fake_reset();
+        nvomx_fake_set_latency(NVOMX_FAKE_GET_HANDLE, getUs);
+        nvomx_fake_set_latency(NVOMX_FAKE_FREE_HANDLE, freeUs);
+
+        OMXPluginBase *plugin = new_plugin(false, poolSize);
+        int64_t firstFrameNs = 0, cycleNs = 0;
+        AllocCount before = sAllocs;
+
+        for (int i = 0; i < cycles; ++i) {
+            Client client;
+            int64_t start = now_ns();
+
+            CHECK(client_make(plugin, TEST_COMPONENT, &client) ==
+                    OMX_ErrorNone);
+            client_decode_one(&client);
+            plugin->destroyComponentInstance(client.mComponent);
+
+            firstFrameNs += client.mFirstFrameNs - start;
+            cycleNs += now_ns() - start;
+        }
+
+        printf("first frame, pool %d: %.2fms, cycle %.2fms, "
+                "%u GetHandle, %.1f allocations per cycle\n", poolSize,
+                firstFrameNs / 1e6 / cycles, cycleNs / 1e6 / cycles,
+                fake_calls(NVOMX_FAKE_GET_HANDLE),
+                (double)(sAllocs.mCalls - before.mCalls) / cycles);
+        delete plugin;
+    }
+}
+
+int main(int argc, char **argv) {
+    int cycles = argc > 1 ? atoi(argv[1]) : 20;
+    unsigned getUs = argc > 2 ? atoi(argv[2]) : 30000;
+    unsigned freeUs = argc > 3 ? atoi(argv[3]) : 10000;
+    Dl_info info;
+
+    if (cycles <= 0) {
+        fprintf(stderr,
+                "usage: %s [cycles] [get_handle_us] [free_handle_us]\n",
+                argv[0]);
+        return 2;
+    }
+
+    // The plugin dlopens the fake by path; this resolves to the copy
+    // already mapped for this executable.
+    if (!dladdr((void *)nvomx_fake_get_stats, &info) ||
+            info.dli_fname == NULL) {
+        fprintf(stderr, "cannot locate the fake libnvomx\n");
+        return 1;
+    }
+    setenv("NVOMX_LIB", info.dli_fname, 1);
+    property_set("debug.nvomx.trace", "0");
+
+    test_registry();
+    test_roles_leak();
+    test_instances();
+    test_pool();
+    test_trace();
+
+    bench_startup();
+    bench_first_frame(cycles, getUs, freeUs);
+
+    if (!HAVE_ALLOC_COUNT) {
+        printf("allocation counts not available on this host\n");
+    }
+    printf("%s\n", sFailures ? "FAILED" : "PASSED");
+    return sFailures ? 1 : 0;
+}
@@ -5,6 +5,12 @@
 // MultiROM needs to init framebuffer, mmc blocks, input devices,
 // some ADB-related stuff and USB drives, if OTG is supported
 // You can use * at the end to init this folder and all its subfolders
+//
+// The trampoline triggers these one after another in this order, so they
+// are grouped by what needs them first: the framebuffer for the menu, then
+// every block device (so partitions are ready before anything probes them),
+// then input, then adb. Recursive "*" entries walk whole subtrees and cost
+// the most; they come last within their group.
 const char *mr_init_devices[] =
 {
     "/sys/devices/tegradc.0/graphics/fb0",
@@ -18,6 +24,8 @@ const char *mr_init_devices[] =
     "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p6", //misc
     "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p8", //data
     "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p10", //extra
+    "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p4", // /system
+    "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p5", // /cache
     "/sys/bus/mmc",
     "/sys/bus/mmc/drivers/mmcblk",
     //"/sys/bus/mmc/drivers/mmc_test",
@@ -25,17 +33,15 @@ const char *mr_init_devices[] =
     "/sys/module/mmc_core",
     "/sys/module/mmcblk",
 
-    "/sys/devices/platform/gpio-keys.0/input*",
-    "/sys/devices/virtual/input*",
-    "/sys/devices/virtual/misc/uinput",
     "/sys/devices/platform/tegra-i2c.1/i2c-1/1-004c/input/input1", // touch screen
     "/sys/devices/platform/tegra-i2c.1/i2c-1/1-004c/input/input1/event1",
     "/sys/devices/platform/tegra-kbc/input/input0", // sec_key
+    "/sys/devices/virtual/misc/uinput",
+    "/sys/devices/platform/gpio-keys.0/input*",
+    "/sys/devices/virtual/input*",
 
     // for adb
     "/sys/devices/virtual/tty/ptmx",
-    "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p4", // /system
-    "/sys/devices/platform/sdhci-tegra.3/mmc_host/mmc0/mmc0:0001/block/mmcblk0/mmcblk0p5", // /cache
     "/sys/devices/virtual/misc/android_adb",
     "/sys/devices/virtual/android_usb/android0/f_adb",
     "/sys/bus/usb",
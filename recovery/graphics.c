@@ -16,6 +16,7 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <fcntl.h>
@@ -24,12 +25,17 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include <linux/fb.h>
 #include <linux/kd.h>
 
 #include <pixelflinger/pixelflinger.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #ifdef BOARD_USE_CUSTOM_RECOVERY_FONT
 #include BOARD_USE_CUSTOM_RECOVERY_FONT
 #else
@@ -49,10 +55,32 @@
 #define PIXEL_SIZE   2
 #endif
 
-#define NUM_BUFFERS 2
+#if PIXEL_SIZE == 4
+typedef uint32_t gr_px;
+#else
+typedef uint16_t gr_px;
+#endif
+
+#define NUM_BUFFERS 3
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
+#endif
+
+/* flips between two fps/blocked time reports */
+#define FLIP_STATS_INTERVAL 600
+
+/*
+ * Glyphs are kept as 1-bpp rows, one 32-bit mask per glyph row with bit 0 the
+ * leftmost pixel, and blitted straight into the draw surface. Fonts wider
+ * than 32 pixels fall back to the pixelflinger texture path.
+ */
+#define GLYPH_MAX_WIDTH 32
+#define GLYPH_COUNT     96
 
 typedef struct {
     GGLSurface texture;
+    uint32_t *glyphs;   /* GLYPH_COUNT * cheight row masks, or NULL */
     unsigned cwidth;
     unsigned cheight;
     unsigned ascent;
@@ -63,12 +91,53 @@ static GGLContext *gr_context = 0;
 static GGLSurface gr_font_texture;
 static GGLSurface gr_framebuffer[NUM_BUFFERS];
 static GGLSurface gr_mem_surface;
+static GGLSurface *gr_draw = 0;
 static unsigned gr_active_fb = 0;
 static unsigned double_buffering = 0;
+static unsigned gr_num_buffers = 1;
+static unsigned char gr_current_r = 255;
+static unsigned char gr_current_g = 255;
+static unsigned char gr_current_b = 255;
+static unsigned char gr_current_a = 255;
+static gr_px gr_current_px = 0;
 static int overscan_percent = OVERSCAN_PERCENT;
 static int overscan_offset_x = 0;
 static int overscan_offset_y = 0;
 
+/*
+ * Render modes. With two or more buffers, outside charger mode, drawing goes
+ * straight into the back framebuffer (see direct rendering below). Otherwise
+ * it goes to gr_mem_surface, a cached copy of the frame, and the rows that
+ * changed are copied out on flip. Either way a buffer is never caught up by
+ * reading the framebuffer back: it is mapped write-combined, so every load
+ * from it stalls.
+ *
+ * Dirty row tracking. Drawing calls grow gr_dirty[0] to cover the rows they
+ * touch, and gr_flip only copies those rows from gr_mem_surface. The buffer
+ * being flipped to last received the frame a few flips ago, so the rows
+ * dirtied by the frames in between are copied too; gr_dirty[i] holds the
+ * rows of the frame i flips back.
+ */
+typedef struct {
+    int y1;
+    int y2;     /* exclusive, empty when y1 >= y2 */
+} GRDirty;
+
+static GRDirty gr_dirty[NUM_BUFFERS];
+
+/*
+ * Flip scheduling. Flips are paced by FBIO_WAITFORVSYNC when the driver has
+ * it, and buffers are switched with FBIOPAN_DISPLAY. A buffer is never drawn
+ * into (or copied to) while it may still be scanned out: with two buffers
+ * each flip waits for the pan to latch, with three the wait comes before the
+ * pan so drawing the next frame overlaps the pending one.
+ */
+static bool gr_vsync = true;
+static bool gr_blanked = false;
+static unsigned gr_flips = 0;
+static unsigned long long gr_flip_start_ns = 0;
+static unsigned long long gr_vsync_blocked_ns = 0;
+
 static int gr_fb_fd = -1;
 static int gr_vt_fd = -1;
 
@@ -79,6 +148,7 @@ static int get_framebuffer(GGLSurface *fb)
 {
     int fd;
     void *bits;
+    unsigned i;
 
     fd = open("/dev/graphics/fb0", O_RDWR);
     if (fd < 0) {
@@ -151,21 +221,34 @@ static int get_framebuffer(GGLSurface *fb)
     fb->format = PIXEL_FORMAT;
     memset(fb->data, 0, vi.yres * fi.line_length);
 
-    fb++;
-
-    /* check if we can use double buffering */
-    if (vi.yres * fi.line_length * 2 > fi.smem_len)
+    /* use as many buffers as fit, up to triple buffering */
+    gr_num_buffers = fi.smem_len / (vi.yres * fi.line_length);
+    if (gr_num_buffers > NUM_BUFFERS)
+        gr_num_buffers = NUM_BUFFERS;
+    while (gr_num_buffers > 1) {
+        vi.yres_virtual = vi.yres * gr_num_buffers;
+        vi.yoffset = 0;
+        if (ioctl(fd, FBIOPUT_VSCREENINFO, &vi) == 0)
+            break;
+        gr_num_buffers--;
+    }
+    if (gr_num_buffers < 2) {
+        gr_num_buffers = 1;
         return fd;
+    }
 
     double_buffering = 1;
 
-    fb->version = sizeof(*fb);
-    fb->width = vi.xres;
-    fb->height = vi.yres;
-    fb->stride = fi.line_length/PIXEL_SIZE;
-    fb->data = (void*) (((unsigned) bits) + vi.yres * fi.line_length);
-    fb->format = PIXEL_FORMAT;
-    memset(fb->data, 0, vi.yres * fi.line_length);
+    for (i = 1; i < gr_num_buffers; i++) {
+        fb++;
+        fb->version = sizeof(*fb);
+        fb->width = vi.xres;
+        fb->height = vi.yres;
+        fb->stride = fi.line_length/PIXEL_SIZE;
+        fb->data = (void*) ((char*) bits + i * vi.yres * fi.line_length);
+        fb->format = PIXEL_FORMAT;
+        memset(fb->data, 0, vi.yres * fi.line_length);
+    }
 
     return fd;
 }
@@ -179,43 +262,421 @@ static void get_memory_surface(GGLSurface* ms) {
   ms->format = PIXEL_FORMAT;
 }
 
+static void gr_mark_dirty(int y1, int y2)
+{
+    if (y1 < 0)
+        y1 = 0;
+    if (y2 > (int) vi.yres)
+        y2 = vi.yres;
+    if (y1 >= y2)
+        return;
+
+    if (gr_dirty[0].y1 >= gr_dirty[0].y2) {
+        gr_dirty[0].y1 = y1;
+        gr_dirty[0].y2 = y2;
+        return;
+    }
+
+    if (y1 < gr_dirty[0].y1)
+        gr_dirty[0].y1 = y1;
+    if (y2 > gr_dirty[0].y2)
+        gr_dirty[0].y2 = y2;
+}
+
+static void gr_mark_all_dirty(void)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_BUFFERS; i++) {
+        gr_dirty[i].y1 = 0;
+        gr_dirty[i].y2 = vi.yres;
+    }
+}
+
+/* union of the rows dirtied by the last 'frames' frames, the current included */
+static GRDirty gr_dirty_rows(unsigned frames)
+{
+    GRDirty d = { (int) vi.yres, 0 };
+    unsigned i;
+
+    for (i = 0; i < frames; i++) {
+        if (gr_dirty[i].y1 >= gr_dirty[i].y2)
+            continue;
+        if (gr_dirty[i].y1 < d.y1)
+            d.y1 = gr_dirty[i].y1;
+        if (gr_dirty[i].y2 > d.y2)
+            d.y2 = gr_dirty[i].y2;
+    }
+
+    return d;
+}
+
+static void gr_dirty_advance(void)
+{
+    unsigned i;
+
+    for (i = NUM_BUFFERS - 1; i > 0; i--)
+        gr_dirty[i] = gr_dirty[i - 1];
+    gr_dirty[0].y1 = gr_dirty[0].y2 = 0;
+}
+
+/*
+ * Copy whole framebuffer rows. The regions are large and never read back
+ * soon, so stream 64 bytes at a time through NEON with a prefetch ahead.
+ */
+static void gr_copy_rows(void *dst, const void *src, size_t len)
+{
+#if defined(__ARM_NEON__)
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+    while (len >= 64) {
+        uint8x16_t q0, q1, q2, q3;
+
+        __builtin_prefetch(s + 256);
+        q0 = vld1q_u8(s);
+        q1 = vld1q_u8(s + 16);
+        q2 = vld1q_u8(s + 32);
+        q3 = vld1q_u8(s + 48);
+        vst1q_u8(d, q0);
+        vst1q_u8(d + 16, q1);
+        vst1q_u8(d + 32, q2);
+        vst1q_u8(d + 48, q3);
+        s += 64;
+        d += 64;
+        len -= 64;
+    }
+    memcpy(d, s, len);
+#else
+    memcpy(dst, src, len);
+#endif
+}
+
+/*
+ * Charger mode. The charger redraws the same handful of animation frames over
+ * and over, so when booted with androidboot.mode=charger draw calls are not
+ * executed right away but recorded, and each frame is keyed by a signature
+ * of its calls. On flip, a frame identical to the one on screen is dropped
+ * without touching the display, a frame seen before is streamed to the
+ * framebuffer from its cached copy, and only a new frame is rendered, into
+ * a RAM cache slot, and kept. A frame whose first drawing call is gr_clear
+ * does not depend on what was on screen before; any other frame's signature
+ * includes the previous frame's.
+ *
+ * The signature only picks candidates: each slot keeps the calls it was
+ * drawn from and what it was drawn over (by generation, a number no other
+ * contents of any slot ever get), and a frame is only reused when all of
+ * that matches exactly. Blits are keyed by surface pointer and pixel
+ * pointer, which is fine for the charger's surfaces as they are loaded once
+ * and kept for the life of the process.
+ */
+#define GR_FRAME_CACHE_SLOTS    6
+#define GR_MAX_OPS              32
+#define GR_OP_TEXT_MAX          64
+
+enum {
+    GR_OP_COLOR,
+    GR_OP_CLEAR,
+    GR_OP_FILL,
+    GR_OP_BLIT,
+    GR_OP_TEXTICON,
+    GR_OP_TEXT,
+};
+
+typedef struct {
+    int op;
+    int arg[6];
+    gr_surface surface;
+    const void *pixels;     /* the surface's data when recorded */
+    char text[GR_OP_TEXT_MAX];
+} GROp;
+
+typedef struct {
+    GGLSurface surface;
+    uint32_t sig;
+    unsigned gen;           /* of the contents, 0 if never drawn */
+    unsigned base_gen;      /* of what it was drawn over, 0 if cleared */
+    GROp ops[GR_MAX_OPS];
+    unsigned num_ops;
+    bool valid;
+    unsigned last_used;
+} GRFrame;
+
+static bool gr_charger = false;
+static bool gr_replaying = false;
+static bool gr_ops_flushed = false;
+static bool gr_ops_drawn = false;
+static bool gr_ops_from_clear = false;
+static GROp gr_ops[GR_MAX_OPS];
+static unsigned gr_num_ops = 0;
+static uint32_t gr_ops_sig = 0;
+static GRFrame gr_frames[GR_FRAME_CACHE_SLOTS];
+static int gr_frame_shown = -1;
+static int gr_frame_work = -1;
+static unsigned gr_frame_clock = 0;
+static unsigned gr_frame_gen = 0;
+static unsigned gr_frames_skipped = 0;
+static unsigned gr_frames_hit = 0;
+static unsigned gr_frames_rendered = 0;
+
+/*
+ * Direct rendering. Calls draw into gr_framebuffer[gr_draw_fb] as they come
+ * and are also logged, and the logs of the last few frames are kept. The
+ * buffer drawn into next still holds the frame from gr_num_buffers - 1 flips
+ * ago, so before the first call that draws into it the frames it missed are
+ * replayed into it from their logs. When that first call covers the whole
+ * buffer, a gr_clear or an opaque full-screen fill as recovery starts its
+ * screen with, the replay is skipped.
+ *
+ * A frame that can't be logged, because it has too many calls or
+ * gr_fb_data handed the buffer out, drops drawing back to gr_mem_surface
+ * for good; that costs one read of a whole framebuffer. Blits are logged by
+ * surface pointer, as in charger mode.
+ */
+#define GR_LOG_MAX_OPS      256
+#define GR_LOG_TEXT_MAX     (16 * 1024)
+
+typedef struct {
+    GROp ops[GR_LOG_MAX_OPS];   /* GR_OP_TEXT keeps its offset in text in arg[2] */
+    unsigned num_ops;
+    char text[GR_LOG_TEXT_MAX];
+    unsigned text_len;
+    bool complete;
+    unsigned char color[4];     /* current color when the frame started */
+} GRLog;
+
+static bool gr_direct = false;
+static unsigned gr_draw_fb = 0;
+static unsigned gr_draw_behind = 0;     /* frames gr_draw_fb is missing */
+static GRLog gr_logs[NUM_BUFFERS];
+static unsigned gr_log_head = 0;
+static unsigned gr_frames_replayed = 0;
+static unsigned gr_frames_covered = 0;
+
+static void gr_charger_init(void);
+static void gr_charger_exit(void);
+static bool gr_charger_flip(void);
+static void gr_charger_flush(void);
+static void gr_replay(const GROp *op, const char *text);
+static void gr_direct_init(void);
+static void gr_direct_flip(void);
+static void gr_direct_catch_up(const GROp *op);
+static void gr_direct_log(const GROp *op, const char *text);
+static void gr_shadow_fallback(const void *src);
+
+static uint32_t gr_hash(uint32_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    while (len--)
+        hash = (hash ^ *p++) * 16777619u;   /* FNV-1a */
+
+    return hash;
+}
+
+/* start recording a new frame */
+static void gr_ops_reset(void)
+{
+    gr_num_ops = 0;
+    gr_ops_sig = 2166136261u;
+    gr_ops_drawn = false;
+    gr_ops_from_clear = false;
+}
+
+/*
+ * true while drawing calls are being recorded rather than executed (charger
+ * mode) or logged as they are executed (direct rendering)
+ */
+static inline bool gr_recording(void)
+{
+    return !gr_replaying && (gr_direct || (gr_charger && !gr_ops_flushed));
+}
+
+/*
+ * Returns true when the call was recorded for later, in which case the
+ * caller must not draw. 'text' is the string of a GR_OP_TEXT call. Only
+ * called when gr_recording().
+ */
+static bool gr_record(const GROp *op, const char *text)
+{
+    GROp *rec;
+
+    if (gr_direct) {
+        if (op->op != GR_OP_COLOR)
+            gr_direct_catch_up(op);
+        gr_direct_log(op, text);
+        return false;
+    }
+
+    /* too long to record: draw it, after what came before, for real */
+    if (text && strlen(text) >= GR_OP_TEXT_MAX) {
+        gr_charger_flush();
+        return false;
+    }
+
+    if (gr_num_ops == GR_MAX_OPS) {
+        /* too busy to be worth caching, draw this frame for real */
+        gr_charger_flush();
+        return false;
+    }
+
+    if (!gr_ops_drawn && op->op != GR_OP_COLOR) {
+        gr_ops_drawn = true;
+        gr_ops_from_clear = op->op == GR_OP_CLEAR;
+    }
+
+    rec = &gr_ops[gr_num_ops++];
+    *rec = *op;
+    if (rec->surface)
+        rec->pixels = ((GGLSurface*) rec->surface)->data;
+    if (text)
+        strcpy(rec->text, text);
+    gr_ops_sig = gr_hash(gr_ops_sig, &rec->op, sizeof(rec->op));
+    gr_ops_sig = gr_hash(gr_ops_sig, rec->arg, sizeof(rec->arg));
+    gr_ops_sig = gr_hash(gr_ops_sig, &rec->surface, sizeof(rec->surface));
+    gr_ops_sig = gr_hash(gr_ops_sig, rec->text, strlen(rec->text));
+
+    return true;
+}
+
 static void set_active_framebuffer(unsigned n)
 {
-    if (n > 1 || !double_buffering) return;
-    vi.yres_virtual = vi.yres * NUM_BUFFERS;
+    if (n >= gr_num_buffers || !double_buffering) return;
+    vi.yres_virtual = vi.yres * gr_num_buffers;
     vi.yoffset = n * vi.yres;
     vi.bits_per_pixel = PIXEL_SIZE * 8;
-    if (ioctl(gr_fb_fd, FBIOPUT_VSCREENINFO, &vi) < 0) {
+    if (ioctl(gr_fb_fd, FBIOPAN_DISPLAY, &vi) < 0 &&
+        ioctl(gr_fb_fd, FBIOPUT_VSCREENINFO, &vi) < 0) {
         perror("active fb swap failed");
     }
 }
 
+static unsigned long long gr_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void gr_wait_vsync(void)
+{
+    unsigned long long start;
+    __u32 crtc = 0;
+
+    /* a blanked panel raises no vblank interrupts */
+    if (!gr_vsync || gr_blanked)
+        return;
+
+    start = gr_now_ns();
+    if (ioctl(gr_fb_fd, FBIO_WAITFORVSYNC, &crtc) < 0) {
+        perror("FBIO_WAITFORVSYNC unsupported, flips are unpaced");
+        gr_vsync = false;
+        return;
+    }
+    gr_vsync_blocked_ns += gr_now_ns() - start;
+}
+
+static void gr_flip_stats(void)
+{
+    unsigned long long elapsed = gr_now_ns() - gr_flip_start_ns;
+
+    if (!gr_flips || !elapsed)
+        return;
+
+    fprintf(stderr, "gr_flip: %u flips, %u.%01u fps, %llu ms blocked on vsync (%s)\n",
+            gr_flips, (unsigned) (gr_flips * 1000000000ULL / elapsed),
+            (unsigned) (gr_flips * 10000000000ULL / elapsed % 10),
+            gr_vsync_blocked_ns / 1000000ULL, gr_vsync ? "paced" : "unpaced");
+
+    gr_flips = 0;
+    gr_vsync_blocked_ns = 0;
+    gr_flip_start_ns = gr_now_ns();
+}
+
+/* make buffer n the one on screen */
+static void gr_present(unsigned n)
+{
+    if (gr_num_buffers > 2) {
+        gr_wait_vsync();
+        set_active_framebuffer(n);
+    } else {
+        set_active_framebuffer(n);
+        gr_wait_vsync();
+    }
+    gr_active_fb = n;
+}
+
 void gr_flip(void)
 {
-    GGLContext *gl = gr_context;
+    unsigned next;
+    GRDirty d;
 
-    /* swap front and back buffers */
-    if (double_buffering)
-        gr_active_fb = (gr_active_fb + 1) & 1;
+    if (gr_charger_flip())
+        return;
 
-    /* copy data from the in-memory surface to the buffer we're about
-     * to make active. */
-    memcpy(gr_framebuffer[gr_active_fb].data, gr_mem_surface.data,
-           fi.line_length * vi.yres);
+    if (++gr_flips >= FLIP_STATS_INTERVAL)
+        gr_flip_stats();
+
+    if (gr_direct) {
+        /* a frame that drew nothing still has to show the last one */
+        gr_direct_catch_up(NULL);
+        if (gr_direct) {
+            gr_direct_flip();
+            return;
+        }
+    }
+
+    /* swap front and back buffers */
+    next = (gr_active_fb + 1) % gr_num_buffers;
+
+    /* with a single buffer we copy into what is being scanned out, so at
+     * least start at the vblank */
+    if (!double_buffering)
+        gr_wait_vsync();
+
+    /* copy the rows that changed since this buffer was last shown from
+     * the in-memory surface to the buffer we're about to make active. */
+    d = gr_dirty_rows(gr_num_buffers);
+    if (d.y1 < d.y2)
+        gr_copy_rows((char*) gr_framebuffer[next].data + d.y1 * fi.line_length,
+                     (char*) gr_mem_surface.data + d.y1 * fi.line_length,
+                     (d.y2 - d.y1) * fi.line_length);
+    gr_dirty_advance();
 
     /* inform the display driver */
-    set_active_framebuffer(gr_active_fb);
+    if (double_buffering)
+        gr_present(next);
 }
 
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
     GGLContext *gl = gr_context;
     GGLint color[4];
+
+    if (gr_recording()) {
+        GROp op = { GR_OP_COLOR, { r, g, b, a } };
+        if (gr_record(&op, NULL))
+            return;
+    }
+
     color[0] = ((r << 8) | r) + 1;
     color[1] = ((g << 8) | g) + 1;
     color[2] = ((b << 8) | b) + 1;
     color[3] = ((a << 8) | a) + 1;
     gl->color4xv(gl, color);
+
+    gr_current_r = r;
+    gr_current_g = g;
+    gr_current_b = b;
+    gr_current_a = a;
+#if defined(RECOVERY_BGRA)
+    gr_current_px = b | (g << 8) | (r << 16) | ((uint32_t) a << 24);
+#elif defined(RECOVERY_RGBX)
+    gr_current_px = r | (g << 8) | (b << 16) | ((uint32_t) a << 24);
+#else
+    gr_current_px = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+#endif
 }
 
 int gr_measure(const char *s)
@@ -229,17 +690,100 @@ void gr_font_size(int *x, int *y)
     *y = gr_font->cheight;
 }
 
+/* paint the pixels of one glyph row whose bits are set in 'bits' */
+static inline void gr_glyph_row(gr_px *dst, uint32_t bits, int w, gr_px color)
+{
+#if defined(__ARM_NEON__) && PIXEL_SIZE == 4
+    static const uint8_t lane_bits[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x8_t lanes = vld1_u8(lane_bits);
+    const uint32x4_t c = vdupq_n_u32(color);
+
+    for (; w >= 8; w -= 8, dst += 8, bits >>= 8) {
+        uint8_t m = bits & 0xff;
+        int16x8_t m16;
+
+        if (m == 0)
+            continue;
+        if (m == 0xff) {
+            vst1q_u32(dst, c);
+            vst1q_u32(dst + 4, c);
+            continue;
+        }
+
+        /* 0xff per set bit, sign-extended to a full-width select mask */
+        m16 = vmovl_s8(vreinterpret_s8_u8(vtst_u8(vdup_n_u8(m), lanes)));
+        vst1q_u32(dst, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(m16))),
+                                 c, vld1q_u32(dst)));
+        vst1q_u32(dst + 4, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(m16))),
+                                     c, vld1q_u32(dst + 4)));
+    }
+#endif
+    for (; w > 0 && bits; w--, dst++, bits >>= 1) {
+        if (bits & 1)
+            *dst = color;
+    }
+}
+
+static void gr_glyph(const uint32_t *rows, int x, int y)
+{
+    GRFont *font = gr_font;
+    int w = font->cwidth;
+    int h = font->cheight;
+    int skip = 0;
+    char *line;
+
+    if (x < 0) {
+        skip = -x;
+        w += x;
+        x = 0;
+    }
+    if (x + w > (int) gr_draw->width)
+        w = gr_draw->width - x;
+    if (y < 0) {
+        rows -= y;
+        h += y;
+        y = 0;
+    }
+    if (y + h > (int) gr_draw->height)
+        h = gr_draw->height - y;
+    if (w <= 0 || h <= 0)
+        return;
+
+    line = (char*) gr_draw->data + (y * gr_draw->stride + x) * PIXEL_SIZE;
+    for (; h > 0; h--, rows++, line += gr_draw->stride * PIXEL_SIZE)
+        gr_glyph_row((gr_px*) line, *rows >> skip, w, gr_current_px);
+}
+
 int gr_text(int x, int y, const char *s, ...)
 {
     GGLContext *gl = gr_context;
     GRFont *font = gr_font;
     unsigned off;
 
+    if (gr_recording()) {
+        GROp op = { GR_OP_TEXT, { x, y } };
+        if (gr_record(&op, s))
+            return x + overscan_offset_x + strlen(s) * font->cwidth;
+    }
+
     x += overscan_offset_x;
     y += overscan_offset_y;
 
     y -= font->ascent;
 
+    gr_mark_dirty(y, y + font->cheight);
+
+    if (font->glyphs) {
+        while((off = *s++)) {
+            off -= 32;
+            if (off < GLYPH_COUNT)
+                gr_glyph(font->glyphs + off * font->cheight, x, y);
+            x += font->cwidth;
+        }
+
+        return x;
+    }
+
     gl->bindTexture(gl, &font->texture);
     gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
     gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
@@ -264,6 +808,12 @@ void gr_texticon(int x, int y, gr_surface icon) {
     }
     GGLContext* gl = gr_context;
 
+    if (gr_recording()) {
+        GROp op = { GR_OP_TEXTICON, { x, y }, icon };
+        if (gr_record(&op, NULL))
+            return;
+    }
+
     x += overscan_offset_x;
     y += overscan_offset_y;
 
@@ -276,18 +826,128 @@ void gr_texticon(int x, int y, gr_surface icon) {
     int w = gr_get_width(icon);
     int h = gr_get_height(icon);
 
+    gr_mark_dirty(y, y + h);
+
     gl->texCoord2i(gl, -x, -y);
     gl->recti(gl, x, y, x+gr_get_width(icon), y+gr_get_height(icon));
 }
 
+/*
+ * Clip a rectangle (x2/y2 exclusive) to the draw surface. Returns false when
+ * nothing is left.
+ */
+static bool gr_clip(int *x1, int *y1, int *x2, int *y2)
+{
+    if (*x1 < 0)
+        *x1 = 0;
+    if (*y1 < 0)
+        *y1 = 0;
+    if (*x2 > (int) gr_draw->width)
+        *x2 = gr_draw->width;
+    if (*y2 > (int) gr_draw->height)
+        *y2 = gr_draw->height;
+
+    return *x1 < *x2 && *y1 < *y2;
+}
+
+/* solid fill of w x h pixels, 'stride' in pixels */
+static void gr_fill_solid(gr_px *dst, int stride, int w, int h, gr_px color)
+{
+    for (; h > 0; h--, dst += stride) {
+        gr_px *p = dst;
+        int n = w;
+#if defined(__ARM_NEON__)
+#if PIXEL_SIZE == 4
+        const uint32x4_t c = vdupq_n_u32(color);
+
+        for (; n >= 8; n -= 8, p += 8) {
+            vst1q_u32(p, c);
+            vst1q_u32(p + 4, c);
+        }
+#else
+        const uint16x8_t c = vdupq_n_u16(color);
+
+        for (; n >= 16; n -= 16, p += 16) {
+            vst1q_u16(p, c);
+            vst1q_u16(p + 8, c);
+        }
+#endif
+#endif
+        for (; n > 0; n--)
+            *p++ = color;
+    }
+}
+
+#if PIXEL_SIZE == 4
+/*
+ * Blend 'color' with alpha 'a' over w x h pixels, per byte:
+ * d = (c * a + d * (255 - a)) / 255, rounded.
+ */
+static void gr_fill_blend(gr_px *dst, int stride, int w, int h, gr_px color, unsigned a)
+{
+    const unsigned ia = 255 - a;
+    const unsigned char *cb = (const unsigned char *) &color;
+
+    for (; h > 0; h--, dst += stride) {
+        unsigned char *p = (unsigned char *) dst;
+        int n = w * PIXEL_SIZE;
+#if defined(__ARM_NEON__)
+        const uint8x16_t c = vreinterpretq_u8_u32(vdupq_n_u32(color));
+        const uint16x8_t c_lo = vmull_u8(vget_low_u8(c), vdup_n_u8(a));
+        const uint16x8_t c_hi = vmull_u8(vget_high_u8(c), vdup_n_u8(a));
+        const uint8x8_t via = vdup_n_u8(ia);
+
+        for (; n >= 16; n -= 16, p += 16) {
+            uint8x16_t d = vld1q_u8(p);
+            uint16x8_t lo = vmlal_u8(c_lo, vget_low_u8(d), via);
+            uint16x8_t hi = vmlal_u8(c_hi, vget_high_u8(d), via);
+
+            /* x / 255 == (x + (x >> 8) + 128) >> 8 for x <= 255 * 255 */
+            vst1q_u8(p, vcombine_u8(vraddhn_u16(lo, vshrq_n_u16(lo, 8)),
+                                    vraddhn_u16(hi, vshrq_n_u16(hi, 8))));
+        }
+#endif
+        for (; n > 0; n--, p++) {
+            unsigned x = cb[(p - (unsigned char *) dst) & 3] * a + *p * ia;
+
+            *p = (x + (x >> 8) + 128) >> 8;
+        }
+    }
+}
+#endif
+
 void gr_fill(int x1, int y1, int x2, int y2)
 {
+    if (gr_recording()) {
+        GROp op = { GR_OP_FILL, { x1, y1, x2, y2 } };
+        if (gr_record(&op, NULL))
+            return;
+    }
+
     x1 += overscan_offset_x;
     y1 += overscan_offset_y;
 
     x2 += overscan_offset_x;
     y2 += overscan_offset_y;
 
+    gr_mark_dirty(y1, y2);
+
+    if (gr_current_a == 255 || (PIXEL_SIZE == 4 && gr_current_a != 0)) {
+        gr_px *dst;
+
+        if (!gr_clip(&x1, &y1, &x2, &y2))
+            return;
+
+        dst = (gr_px*) gr_draw->data + y1 * gr_draw->stride + x1;
+        if (gr_current_a == 255)
+            gr_fill_solid(dst, gr_draw->stride, x2 - x1, y2 - y1, gr_current_px);
+#if PIXEL_SIZE == 4
+        else
+            gr_fill_blend(dst, gr_draw->stride, x2 - x1, y2 - y1, gr_current_px, gr_current_a);
+#endif
+        return;
+    }
+
     GGLContext *gl = gr_context;
     gl->disable(gl, GGL_TEXTURE_2D);
     gl->recti(gl, x1, y1, x2, y2);
@@ -298,11 +958,67 @@ void gr_blit(gr_surface source, int sx, int sy, int w, int h, int dx, int dy) {
         return;
     }
     GGLContext *gl = gr_context;
+    GGLSurface *src = (GGLSurface*) source;
+
+    if (gr_recording()) {
+        GROp op = { GR_OP_BLIT, { sx, sy, w, h, dx, dy }, source };
+        if (gr_record(&op, NULL))
+            return;
+    }
 
     dx += overscan_offset_x;
     dy += overscan_offset_y;
 
-    gl->bindTexture(gl, (GGLSurface*) source);
+    gr_mark_dirty(dy, dy + h);
+
+    /* opaque sources in our own format are plain row copies */
+    if (src->format == PIXEL_FORMAT && src->format != GGL_PIXEL_FORMAT_BGRA_8888) {
+        char *d;
+        const char *s;
+
+        /* clip against the source, then against the draw surface */
+        if (sx < 0) {
+            dx -= sx;
+            w += sx;
+            sx = 0;
+        }
+        if (sy < 0) {
+            dy -= sy;
+            h += sy;
+            sy = 0;
+        }
+        if (w > (int) src->width - sx)
+            w = src->width - sx;
+        if (h > (int) src->height - sy)
+            h = src->height - sy;
+        if (dx < 0) {
+            sx -= dx;
+            w += dx;
+            dx = 0;
+        }
+        if (dy < 0) {
+            sy -= dy;
+            h += dy;
+            dy = 0;
+        }
+        if (w > (int) gr_draw->width - dx)
+            w = gr_draw->width - dx;
+        if (h > (int) gr_draw->height - dy)
+            h = gr_draw->height - dy;
+        if (w <= 0 || h <= 0)
+            return;
+
+        d = (char*) gr_draw->data + (dy * gr_draw->stride + dx) * PIXEL_SIZE;
+        s = (const char*) src->data + (sy * src->stride + sx) * PIXEL_SIZE;
+        for (; h > 0; h--) {
+            gr_copy_rows(d, s, w * PIXEL_SIZE);
+            d += gr_draw->stride * PIXEL_SIZE;
+            s += src->stride * PIXEL_SIZE;
+        }
+        return;
+    }
+
+    gl->bindTexture(gl, src);
     gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
     gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
     gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
@@ -332,6 +1048,35 @@ static void gr_init_font(void)
     unsigned char *in, data;
 
     gr_font = calloc(sizeof(*gr_font), 1);
+    gr_font->cwidth = font.cwidth;
+    gr_font->cheight = font.cheight;
+    gr_font->ascent = font.cheight - 2;
+
+    /* decode the RLE straight into glyph row masks */
+    if (font.cwidth <= GLYPH_MAX_WIDTH)
+        gr_font->glyphs = calloc(GLYPH_COUNT * font.cheight, sizeof(uint32_t));
+    if (gr_font->glyphs) {
+        unsigned pos = 0, end = font.width * font.height;
+
+        in = font.rundata;
+        while((data = *in++)) {
+            unsigned run = data & 0x7f;
+
+            if (data & 0x80) {
+                for (; run && pos < end; run--, pos++) {
+                    unsigned px = pos % font.width, py = pos / font.width;
+                    unsigned glyph = px / font.cwidth;
+
+                    if (glyph < GLYPH_COUNT)
+                        gr_font->glyphs[glyph * font.cheight + py] |= 1u << (px % font.cwidth);
+                }
+            } else {
+                pos += run;
+            }
+        }
+        return;
+    }
+
     ftex = &gr_font->texture;
 
     bits = malloc(font.width * font.height);
@@ -348,10 +1093,6 @@ static void gr_init_font(void)
         memset(bits, (data & 0x80) ? 255 : 0, data & 0x7f);
         bits += (data & 0x7f);
     }
-
-    gr_font->cwidth = font.cwidth;
-    gr_font->cheight = font.cheight;
-    gr_font->ascent = font.cheight - 2;
 }
 
 int gr_init(void)
@@ -377,15 +1118,30 @@ int gr_init(void)
         return -1;
     }
 
-    get_memory_surface(&gr_mem_surface);
+    gr_charger_init();
+
+    /* the charger draws into its frame cache instead; every framebuffer
+     * starts out cleared, so none is behind */
+    if (double_buffering && !gr_charger) {
+        gr_direct_init();
+    } else if (!gr_charger) {
+        get_memory_surface(&gr_mem_surface);
+        gr_draw = &gr_mem_surface;
+        gr_mark_all_dirty();
+    }
 
-    fprintf(stderr, "framebuffer: fd %d (%d x %d)\n",
-            gr_fb_fd, gr_framebuffer[0].width, gr_framebuffer[0].height);
+    fprintf(stderr, "framebuffer: fd %d (%d x %d), %u buffers, %s rendering\n",
+            gr_fb_fd, gr_framebuffer[0].width, gr_framebuffer[0].height,
+            gr_num_buffers, gr_charger ? "cached charger" :
+            gr_direct ? "direct" : "shadow");
 
         /* start with 0 as front (displayed) and 1 as back (drawing) */
     gr_active_fb = 0;
     set_active_framebuffer(0);
-    gl->colorBuffer(gl, &gr_mem_surface);
+    if (gr_charger)
+        gr_draw = &gr_frames[gr_frame_shown].surface;
+    gl->colorBuffer(gl, gr_draw);
+    gr_flip_start_ns = gr_now_ns();
 
     gl->activeTexture(gl, 0);
     gl->enable(gl, GGL_BLEND);
@@ -396,10 +1152,20 @@ int gr_init(void)
 
 void gr_exit(void)
 {
+    gr_flip_stats();
+
+    if (gr_frames_replayed || gr_frames_covered)
+        fprintf(stderr, "direct rendering: %u frames replayed into a stale buffer, "
+                "%u redrawn in full\n", gr_frames_replayed, gr_frames_covered);
+    gr_direct = false;
+
     close(gr_fb_fd);
     gr_fb_fd = -1;
 
     free(gr_mem_surface.data);
+    gr_mem_surface.data = NULL;
+
+    gr_charger_exit();
 
     ioctl(gr_vt_fd, KDSETMODE, (void*) KD_TEXT);
     close(gr_vt_fd);
@@ -418,7 +1184,19 @@ int gr_fb_height(void)
 
 gr_pixel *gr_fb_data(void)
 {
-    return (unsigned short *) gr_mem_surface.data;
+    /* pending calls must land first, and the frame can't be cached */
+    gr_charger_flush();
+
+    /* nor logged: draw into a shadow surface from now on */
+    if (gr_direct) {
+        gr_direct_catch_up(NULL);
+        if (gr_direct)
+            gr_shadow_fallback(gr_draw->data);
+    }
+
+    /* the caller may scribble anywhere */
+    gr_mark_dirty(0, vi.yres);
+    return (unsigned short *) gr_draw->data;
 }
 
 void gr_fb_blank(bool blank)
@@ -428,11 +1206,441 @@ void gr_fb_blank(bool blank)
     ret = ioctl(gr_fb_fd, FBIOBLANK, blank ? FB_BLANK_POWERDOWN : FB_BLANK_UNBLANK);
     if (ret < 0)
         perror("ioctl(): blank");
+    else
+        gr_blanked = blank;
 }
 
 // These are new graphics functions from 5.0 that were not available in
 // 4.4 that are required by charger and healthd
 void gr_clear()
 {
-    return;
+    if (gr_recording()) {
+        GROp op = { GR_OP_CLEAR };
+        if (gr_record(&op, NULL))
+            return;
+    }
+
+    gr_mark_dirty(0, gr_draw->height);
+
+    /* like minui, ignore alpha and clear the whole surface, overscan too */
+    if (gr_current_r == gr_current_g && gr_current_r == gr_current_b &&
+        (PIXEL_SIZE == 4 || gr_current_r == 0 || gr_current_r == 255)) {
+        memset(gr_draw->data, gr_current_r, gr_draw->height * gr_draw->stride * PIXEL_SIZE);
+        return;
+    }
+
+#if defined(RECOVERY_BGRA) || defined(RECOVERY_RGBX)
+    gr_fill_solid((gr_px*) gr_draw->data, gr_draw->stride, gr_draw->width, gr_draw->height,
+                  gr_current_px | 0xff000000);
+#else
+    gr_fill_solid((gr_px*) gr_draw->data, gr_draw->stride, gr_draw->width, gr_draw->height,
+                  gr_current_px);
+#endif
+}
+
+static bool gr_charger_boot(void)
+{
+    char cmdline[1024];
+    ssize_t len;
+    int fd;
+
+    fd = open("/proc/cmdline", O_RDONLY);
+    if (fd < 0)
+        return false;
+    len = read(fd, cmdline, sizeof(cmdline) - 1);
+    close(fd);
+    if (len <= 0)
+        return false;
+    cmdline[len] = 0;
+
+    return strstr(cmdline, "androidboot.mode=charger") != NULL;
+}
+
+static bool gr_frame_alloc(GRFrame *f)
+{
+    if (f->surface.data)
+        return true;
+
+    f->surface.version = sizeof(f->surface);
+    f->surface.width = vi.xres;
+    f->surface.height = vi.yres;
+    f->surface.stride = fi.line_length/PIXEL_SIZE;
+    f->surface.format = PIXEL_FORMAT;
+    f->surface.data = malloc(fi.line_length * vi.yres);
+
+    return f->surface.data != NULL;
+}
+
+static void gr_charger_init(void)
+{
+    if (!gr_charger_boot())
+        return;
+
+    /* slot 0 mirrors the cleared framebuffer until the first flip */
+    if (!gr_frame_alloc(&gr_frames[0])) {
+        fprintf(stderr, "charger frame cache unavailable\n");
+        return;
+    }
+    memset(gr_frames[0].surface.data, 0, fi.line_length * vi.yres);
+    gr_frames[0].valid = false;
+    gr_frames[0].gen = ++gr_frame_gen;
+    gr_frame_shown = 0;
+    gr_ops_reset();
+    gr_charger = true;
+}
+
+static void gr_charger_exit(void)
+{
+    unsigned i;
+
+    if (gr_charger)
+        fprintf(stderr, "charger frames: %u rendered, %u from cache, %u skipped\n",
+                gr_frames_rendered, gr_frames_hit, gr_frames_skipped);
+
+    for (i = 0; i < GR_FRAME_CACHE_SLOTS; i++) {
+        free(gr_frames[i].surface.data);
+        gr_frames[i].surface.data = NULL;
+        gr_frames[i].valid = false;
+    }
+    gr_charger = false;
+}
+
+/* least recently used slot that isn't on screen, allocating as needed */
+static int gr_frame_victim(void)
+{
+    int i, victim = -1;
+
+    for (i = 0; i < GR_FRAME_CACHE_SLOTS; i++) {
+        if (i == gr_frame_shown)
+            continue;
+        if (!gr_frames[i].surface.data)
+            return gr_frame_alloc(&gr_frames[i]) ? i : victim;
+        if (victim < 0 || gr_frames[i].last_used < gr_frames[victim].last_used)
+            victim = i;
+    }
+
+    return victim;
+}
+
+static void gr_replay(const GROp *op, const char *text)
+{
+    switch (op->op) {
+    case GR_OP_COLOR:
+        gr_color(op->arg[0], op->arg[1], op->arg[2], op->arg[3]);
+        break;
+    case GR_OP_CLEAR:
+        gr_clear();
+        break;
+    case GR_OP_FILL:
+        gr_fill(op->arg[0], op->arg[1], op->arg[2], op->arg[3]);
+        break;
+    case GR_OP_BLIT:
+        gr_blit(op->surface, op->arg[0], op->arg[1], op->arg[2], op->arg[3],
+                op->arg[4], op->arg[5]);
+        break;
+    case GR_OP_TEXTICON:
+        gr_texticon(op->arg[0], op->arg[1], op->surface);
+        break;
+    case GR_OP_TEXT:
+        gr_text(op->arg[0], op->arg[1], text);
+        break;
+    }
+}
+
+/*
+ * Render the recorded calls into cache slot 'slot' on top of the frame on
+ * screen, and leave that slot as the draw surface.
+ */
+static void gr_charger_render(int slot)
+{
+    GRFrame *f = &gr_frames[slot];
+    unsigned i;
+
+    /* what a cache hit on this slot must match */
+    f->base_gen = gr_ops_from_clear ? 0 : gr_frames[gr_frame_shown].gen;
+    memcpy(f->ops, gr_ops, gr_num_ops * sizeof(GROp));
+    f->num_ops = gr_num_ops;
+    f->valid = false;
+    f->gen = ++gr_frame_gen;
+    if (slot != gr_frame_shown && !gr_ops_from_clear)
+        gr_copy_rows(gr_frames[slot].surface.data, gr_frames[gr_frame_shown].surface.data,
+                     fi.line_length * vi.yres);
+
+    gr_draw = &gr_frames[slot].surface;
+    gr_context->colorBuffer(gr_context, gr_draw);
+
+    gr_replaying = true;
+    for (i = 0; i < gr_num_ops; i++)
+        gr_replay(&gr_ops[i], gr_ops[i].text);
+    gr_replaying = false;
+    gr_ops_reset();
+
+    gr_frame_work = slot;
+}
+
+/* stop recording this frame and draw it for real */
+static void gr_charger_flush(void)
+{
+    int slot;
+
+    if (!gr_charger || gr_ops_flushed)
+        return;
+
+    /* with no slot to spare, draw over the frame on screen */
+    slot = gr_frame_victim();
+    gr_charger_render(slot < 0 ? gr_frame_shown : slot);
+    gr_ops_flushed = true;
+}
+
+/* show cache slot 'slot', a complete frame */
+static void gr_charger_show(int slot)
+{
+    unsigned next = double_buffering ? (gr_active_fb + 1) % gr_num_buffers : 0;
+
+    if (!double_buffering)
+        gr_wait_vsync();
+    gr_copy_rows(gr_framebuffer[next].data, gr_frames[slot].surface.data,
+                 fi.line_length * vi.yres);
+    if (double_buffering)
+        gr_present(next);
+
+    gr_frames[slot].last_used = ++gr_frame_clock;
+    gr_frame_shown = slot;
+}
+
+static bool gr_op_equal(const GROp *a, const GROp *b)
+{
+    return a->op == b->op && !memcmp(a->arg, b->arg, sizeof(a->arg)) &&
+           a->surface == b->surface && a->pixels == b->pixels &&
+           !strcmp(a->text, b->text);
+}
+
+/* does slot 'f' hold exactly the frame recorded, drawn over 'base_gen' */
+static bool gr_frame_matches(const GRFrame *f, uint32_t sig, unsigned base_gen)
+{
+    unsigned i;
+
+    if (!f->valid || f->sig != sig || f->base_gen != base_gen || f->num_ops != gr_num_ops)
+        return false;
+
+    for (i = 0; i < gr_num_ops; i++) {
+        if (!gr_op_equal(&f->ops[i], &gr_ops[i]))
+            return false;
+    }
+
+    return true;
+}
+
+/* returns false when not in charger mode and the normal flip should run */
+static bool gr_charger_flip(void)
+{
+    int i, slot = -1;
+    uint32_t sig = gr_ops_sig;
+    unsigned base_gen = 0;
+    bool cacheable = true;
+
+    if (!gr_charger)
+        return false;
+
+    if (gr_ops_flushed) {
+        /* drawn for real, nothing to key it by */
+        gr_ops_flushed = false;
+        gr_frames_rendered++;
+        gr_charger_show(gr_frame_work);
+        return true;
+    }
+
+    if (!gr_num_ops) {
+        gr_frames_skipped++;
+        return true;
+    }
+
+    /* a frame drawn over the last one is only as known as that one */
+    if (!gr_ops_from_clear) {
+        cacheable = gr_frames[gr_frame_shown].valid;
+        sig = gr_hash(sig, &gr_frames[gr_frame_shown].sig, sizeof(uint32_t));
+        base_gen = gr_frames[gr_frame_shown].gen;
+    }
+
+    if (cacheable && gr_frame_matches(&gr_frames[gr_frame_shown], sig, base_gen)) {
+        gr_ops_reset();
+        gr_frames_skipped++;
+        return true;
+    }
+
+    for (i = 0; cacheable && i < GR_FRAME_CACHE_SLOTS; i++) {
+        if (gr_frame_matches(&gr_frames[i], sig, base_gen)) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot >= 0) {
+        gr_ops_reset();
+        gr_frames_hit++;
+    } else {
+        gr_charger_flush();
+        gr_ops_flushed = false;
+        slot = gr_frame_work;
+        if (cacheable && slot != gr_frame_shown) {
+            gr_frames[slot].sig = sig;
+            gr_frames[slot].valid = true;
+        }
+        gr_frames_rendered++;
+    }
+
+    gr_charger_show(slot);
+    return true;
+}
+
+/* -- direct rendering */
+
+static GRLog *gr_log_frame(unsigned flips_back)
+{
+    return &gr_logs[(gr_log_head + flips_back) % NUM_BUFFERS];
+}
+
+/* start logging a new frame */
+static void gr_log_start(GRLog *log)
+{
+    log->num_ops = 0;
+    log->text_len = 0;
+    log->complete = true;
+    log->color[0] = gr_current_r;
+    log->color[1] = gr_current_g;
+    log->color[2] = gr_current_b;
+    log->color[3] = gr_current_a;
+}
+
+static void gr_direct_init(void)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_BUFFERS; i++)
+        gr_log_start(&gr_logs[i]);
+    gr_draw_fb = 1;
+    gr_draw_behind = 0;
+    gr_draw = &gr_framebuffer[gr_draw_fb];
+    gr_direct = true;
+}
+
+static void gr_direct_log(const GROp *op, const char *text)
+{
+    GRLog *log = gr_log_frame(0);
+    GROp *rec;
+    size_t len;
+
+    /* the catch up before it may have left direct rendering */
+    if (!gr_direct || !log->complete)
+        return;
+
+    if (log->num_ops == GR_LOG_MAX_OPS) {
+        log->complete = false;
+        return;
+    }
+
+    rec = &log->ops[log->num_ops];
+    rec->op = op->op;
+    memcpy(rec->arg, op->arg, sizeof(rec->arg));
+    rec->surface = op->surface;
+    if (text) {
+        len = strlen(text) + 1;
+        if (len > GR_LOG_TEXT_MAX - log->text_len) {
+            log->complete = false;
+            return;
+        }
+        memcpy(log->text + log->text_len, text, len);
+        rec->arg[2] = log->text_len;
+        log->text_len += len;
+    }
+    log->num_ops++;
+}
+
+/* does 'op' paint every pixel of the draw buffer, whatever was there */
+static bool gr_op_covers(const GROp *op)
+{
+    if (op->op == GR_OP_CLEAR)
+        return true;
+
+    return op->op == GR_OP_FILL && gr_current_a == 255 &&
+           op->arg[0] + overscan_offset_x <= 0 &&
+           op->arg[1] + overscan_offset_y <= 0 &&
+           op->arg[2] + overscan_offset_x >= (int) gr_draw->width &&
+           op->arg[3] + overscan_offset_y >= (int) gr_draw->height;
+}
+
+/*
+ * Bring the draw buffer up to the last frame shown before 'op', the first
+ * call of this frame that draws, or NULL, runs.
+ */
+static void gr_direct_catch_up(const GROp *op)
+{
+    unsigned char r = gr_current_r, g = gr_current_g, b = gr_current_b, a = gr_current_a;
+    unsigned i, k;
+
+    if (!gr_draw_behind)
+        return;
+
+    if (op && gr_op_covers(op)) {
+        gr_draw_behind = 0;
+        gr_frames_covered++;
+        return;
+    }
+
+    for (k = gr_draw_behind; k > 0; k--) {
+        if (!gr_log_frame(k)->complete) {
+            /* the buffer shown last has the frame */
+            gr_shadow_fallback(gr_framebuffer[gr_active_fb].data);
+            return;
+        }
+    }
+
+    gr_replaying = true;
+    for (k = gr_draw_behind; k > 0; k--) {
+        GRLog *log = gr_log_frame(k);
+
+        gr_color(log->color[0], log->color[1], log->color[2], log->color[3]);
+        for (i = 0; i < log->num_ops; i++) {
+            const GROp *rec = &log->ops[i];
+            gr_replay(rec, rec->op == GR_OP_TEXT ? log->text + rec->arg[2] : NULL);
+        }
+        gr_frames_replayed++;
+    }
+    gr_color(r, g, b, a);
+    gr_replaying = false;
+
+    gr_draw_behind = 0;
+}
+
+/* show the frame just drawn and move on to the next buffer */
+static void gr_direct_flip(void)
+{
+    gr_present(gr_draw_fb);
+
+    gr_log_head = (gr_log_head + NUM_BUFFERS - 1) % NUM_BUFFERS;
+    gr_log_start(gr_log_frame(0));
+
+    gr_draw_fb = (gr_draw_fb + 1) % gr_num_buffers;
+    gr_draw_behind = gr_num_buffers - 1;
+    gr_draw = &gr_framebuffer[gr_draw_fb];
+    gr_context->colorBuffer(gr_context, gr_draw);
+}
+
+/* leave direct rendering for good, drawing into a copy of 'src' instead */
+static void gr_shadow_fallback(const void *src)
+{
+    gr_draw_behind = 0;
+
+    get_memory_surface(&gr_mem_surface);
+    if (!gr_mem_surface.data) {
+        fprintf(stderr, "no shadow surface, partial redraws may show stale rows\n");
+        return;
+    }
+
+    fprintf(stderr, "framebuffer: falling back to shadow rendering\n");
+    gr_copy_rows(gr_mem_surface.data, src, fi.line_length * vi.yres);
+    gr_direct = false;
+    gr_draw = &gr_mem_surface;
+    gr_context->colorBuffer(gr_context, gr_draw);
+    gr_mark_all_dirty();
 }
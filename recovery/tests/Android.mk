@@ -12,16 +12,16 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-ifneq ($(filter p4 p4wifi p4tmo p4vzw, $(TARGET_DEVICE)),)
-
 LOCAL_PATH := $(call my-dir)
 
+# Host benchmark for graphics.c flips, against a framebuffer file
 include $(CLEAR_VARS)
 
-LOCAL_SHARED_LIBRARIES := liblog libcutils
-LOCAL_SRC_FILES := macloader.c
-LOCAL_MODULE := macloader
-LOCAL_MODULE_TAGS := optional
-include $(BUILD_EXECUTABLE)
+LOCAL_SRC_FILES := gr_flip_bench.c
+LOCAL_C_INCLUDES += bootable/recovery/minui
+LOCAL_CFLAGS += -DRECOVERY_RGBX -DOVERSCAN_PERCENT=0
+LOCAL_LDLIBS := -lrt
 
-endif
+LOCAL_MODULE := gr_flip_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark for recovery/graphics.c flips. The framebuffer is a plain
+ * file mmapped in place of /dev/graphics/fb0, with the fb ioctls emulated
+ * on top of it, and pixelflinger is stubbed out (the paths timed here don't
+ * use it). There is no vsync, so flips run unpaced and the time measured is
+ * the drawing plus what gr_flip copies.
+ *
+ *   gr_flip_bench [-b buffers] [-n frames] [-c] [fbfile]
+ *
+ * -b picks how many buffers the fake framebuffer holds (1 draws through the
+ * shadow surface, 2 and 3 draw directly), -c boots as the charger. After
+ * every flip the buffer on screen must match what was drawn; the bench
+ * fails otherwise. The last workload writes through gr_fb_data, which moves
+ * direct rendering to the shadow surface for good.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/fb.h>
+#include <linux/kd.h>
+
+#include <pixelflinger/pixelflinger.h>
+
+#define FB_XRES     1280
+#define FB_YRES     800
+#define FB_BPP      4
+
+static const char *fb_path = "/tmp/gr_flip_bench.fb";
+static const char *cmdline_path = "/tmp/gr_flip_bench.cmdline";
+static unsigned fb_buffers = 2;
+static unsigned fb_yoffset;
+static bool charger;
+
+static int bench_open(const char *path, int flags, ...)
+{
+    if (!strcmp(path, "/dev/graphics/fb0"))
+        return open(fb_path, O_RDWR);
+    if (!strcmp(path, "/proc/cmdline"))
+        return open(cmdline_path, O_RDONLY);
+
+    /* no tty0 */
+    errno = ENOENT;
+    return -1;
+}
+
+static int bench_ioctl(int fd, unsigned long request, ...)
+{
+    struct fb_var_screeninfo *vi;
+    struct fb_fix_screeninfo *fi;
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    switch (request) {
+    case FBIOGET_VSCREENINFO:
+        vi = arg;
+        memset(vi, 0, sizeof(*vi));
+        vi->xres = vi->xres_virtual = FB_XRES;
+        vi->yres = FB_YRES;
+        vi->yres_virtual = FB_YRES * fb_buffers;
+        vi->yoffset = fb_yoffset;
+        vi->bits_per_pixel = FB_BPP * 8;
+        vi->width = 217;
+        vi->height = 136;
+        return 0;
+    case FBIOPUT_VSCREENINFO:
+    case FBIOPAN_DISPLAY:
+        vi = arg;
+        if (vi->yres_virtual > FB_YRES * fb_buffers ||
+            vi->yoffset + FB_YRES > FB_YRES * fb_buffers) {
+            errno = EINVAL;
+            return -1;
+        }
+        fb_yoffset = vi->yoffset;
+        return 0;
+    case FBIOGET_FSCREENINFO:
+        fi = arg;
+        memset(fi, 0, sizeof(*fi));
+        fi->line_length = FB_XRES * FB_BPP;
+        fi->smem_len = FB_XRES * FB_YRES * FB_BPP * fb_buffers;
+        return 0;
+    case FBIOBLANK:
+        return 0;
+    }
+
+    /* FBIO_WAITFORVSYNC included: flips go unpaced */
+    errno = ENOTTY;
+    return -1;
+}
+
+#define open bench_open
+#define ioctl bench_ioctl
+#include "../graphics.c"
+#undef open
+#undef ioctl
+
+/* -- pixelflinger stubs, for the state calls gr_init and friends make */
+
+static void ggl_recti(void *c, GGLint l, GGLint t, GGLint r, GGLint b) { }
+static void ggl_surface(void *c, const GGLSurface *surface) { }
+static void ggl_color4xv(void *c, const GGLclampx *color) { }
+static void ggl_texcoord(void *c, GGLint s, GGLint t) { }
+static void ggl_active(void *c, GGLuint tmu) { }
+static void ggl_env(void *c, GGLenum target, GGLenum pname, GGLint param) { }
+static void ggl_enable(void *c, GGLenum name) { }
+static void ggl_blend(void *c, GGLenum src, GGLenum dst) { }
+
+ssize_t gglInit(GGLContext **context)
+{
+    GGLContext *gl = calloc(1, sizeof(*gl));
+
+    gl->recti = ggl_recti;
+    gl->colorBuffer = ggl_surface;
+    gl->color4xv = ggl_color4xv;
+    gl->texCoord2i = ggl_texcoord;
+    gl->bindTexture = ggl_surface;
+    gl->activeTexture = ggl_active;
+    gl->texEnvi = ggl_env;
+    gl->texGeni = ggl_env;
+    gl->enable = ggl_enable;
+    gl->disable = ggl_enable;
+    gl->blendFunc = ggl_blend;
+    *context = gl;
+    return 0;
+}
+
+/* -- the bench */
+
+#define FRAME_BYTES (FB_XRES * FB_YRES * FB_BPP)
+
+static int failures;
+static unsigned char *expected;     /* what the screen should show */
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const unsigned char *on_screen(void)
+{
+    return (const unsigned char *) gr_framebuffer[0].data + fb_yoffset * FB_XRES * FB_BPP;
+}
+
+/* one frame of each workload, mirrored into 'expected' when checking */
+static void progress_bar(int frame, bool check)
+{
+    int w = (frame * 7) % (FB_XRES - 200) + 1;
+
+    gr_color(0x33, 0x99, 0xcc, 255);
+    gr_fill(100, 600, 100 + w, 624);
+    gr_color(0, 0, 0, 255);
+    gr_fill(100 + w, 600, FB_XRES - 100, 624);
+    if (check) {
+        int y, x;
+
+        for (y = 600; y < 624; y++) {
+            uint32_t *row = (uint32_t *) (expected + y * FB_XRES * FB_BPP);
+            for (x = 100; x < FB_XRES - 100; x++)
+                row[x] = x < 100 + w ? 0xffcc9933 : 0xff000000;
+        }
+    }
+}
+
+/* the text band at rows 700..717, black with 's' drawn in white */
+static void expect_text(const char *s)
+{
+    unsigned char *rows = expected + 700 * FB_XRES * FB_BPP;
+    int i, x, y;
+
+    for (y = 0; y < 18; y++) {
+        uint32_t *row = (uint32_t *) (rows + y * FB_XRES * FB_BPP);
+        for (x = 0; x < FB_XRES; x++)
+            row[x] = 0xff000000;
+    }
+
+    /* glyph rows are drawn from y - ascent, bit 0 leftmost */
+    for (i = 0; s[i]; i++) {
+        unsigned off = s[i] - 32;
+        int top = 700 + 16 - gr_font->ascent;
+
+        if (off >= GLYPH_COUNT || !gr_font->glyphs)
+            continue;
+        for (y = 0; y < (int) gr_font->cheight; y++) {
+            uint32_t bits = gr_font->glyphs[off * gr_font->cheight + y];
+            uint32_t *row = (uint32_t *) (expected + (top + y) * FB_XRES * FB_BPP);
+
+            for (x = 0; x < (int) gr_font->cwidth; x++)
+                if (bits & (1u << x))
+                    row[10 + i * gr_font->cwidth + x] = 0xffffffff;
+        }
+    }
+}
+
+static void draw_text(const char *s, bool check)
+{
+    gr_color(0, 0, 0, 255);
+    gr_fill(0, 700, FB_XRES, 700 + 18);
+    gr_color(255, 255, 255, 255);
+    gr_text(10, 700 + 16, s);
+    if (check)
+        expect_text(s);
+}
+
+static void text_line(int frame, bool check)
+{
+    char line[64];
+
+    snprintf(line, sizeof(line), "Installing update... %3d%%", frame % 101);
+    draw_text(line, check);
+}
+
+/* longer than the charger records, so drawn straight away */
+static void log_line(int frame, bool check)
+{
+    char line[128];
+
+    snprintf(line, sizeof(line), "I:Verifying update package... %3d%% "
+             "(whole-file signature, %d bytes of metadata)", frame % 101, frame);
+    draw_text(line, check);
+}
+
+static void full_redraw(int frame, bool check)
+{
+    unsigned char v = frame & 1 ? 0x20 : 0x40;
+
+    gr_color(v, v, v, 255);
+    gr_clear();
+    if (check)
+        memset(expected, v, FRAME_BYTES);
+}
+
+/* rows 300..309 written through gr_fb_data, which can't be replayed */
+static void scribble(int frame, bool check)
+{
+    uint32_t *fb = (uint32_t *) gr_fb_data();
+    uint32_t v = 0xff000000 | (frame * 0x010203);
+    int y, x;
+
+    for (y = 300; y < 310; y++) {
+        for (x = 0; x < FB_XRES; x++) {
+            fb[y * FB_XRES + x] = v;
+            if (check)
+                ((uint32_t *) expected)[y * FB_XRES + x] = v;
+        }
+    }
+}
+
+static void verify(const char *what, int frame)
+{
+    if (memcmp(on_screen(), expected, FRAME_BYTES)) {
+        printf("FAIL %s frame %d: screen differs from what was drawn\n", what, frame);
+        failures++;
+    }
+}
+
+static void bench(const char *what, void (*draw)(int, bool), int frames)
+{
+    unsigned long long start;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < frames; i++) {
+        draw(i, false);
+        gr_flip();
+    }
+    printf("%-14s %8.1f us/flip\n", what, (now_ns() - start) / 1000.0 / frames);
+
+    /* then a few checked ones, each workload redraws all it touches */
+    for (i = 0; i < 8 && !failures; i++) {
+        draw(i, true);
+        gr_flip();
+        verify(what, i);
+    }
+}
+
+static int make_file(const char *path, const void *data, size_t len)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+    if (fd < 0 || (data ? write(fd, data, len) != (ssize_t) len : ftruncate(fd, len) < 0)) {
+        perror(path);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const char charger_cmdline[] = "console=ttyS0 androidboot.mode=charger\n";
+    int opt, frames = 300;
+
+    while ((opt = getopt(argc, argv, "b:n:c")) != -1) {
+        switch (opt) {
+        case 'b':
+            fb_buffers = atoi(optarg);
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'c':
+            charger = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b buffers] [-n frames] [-c] [fbfile]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc)
+        fb_path = argv[optind];
+    if (fb_buffers < 1 || fb_buffers > NUM_BUFFERS || frames <= 0) {
+        fprintf(stderr, "1 to %d buffers, at least one frame\n", NUM_BUFFERS);
+        return 2;
+    }
+
+    if (make_file(fb_path, NULL, (size_t) FRAME_BYTES * fb_buffers) < 0 ||
+        make_file(cmdline_path, charger ? charger_cmdline : "", charger ? sizeof(charger_cmdline) - 1 : 0) < 0)
+        return 1;
+
+    expected = calloc(1, FRAME_BYTES);
+    if (gr_init() < 0) {
+        fprintf(stderr, "gr_init failed\n");
+        return 1;
+    }
+
+    printf("%ux%u, %u buffer(s), %d frames\n", FB_XRES, FB_YRES, fb_buffers, frames);
+    bench("full redraw", full_redraw, frames);
+    bench("progress bar", progress_bar, frames);
+    bench("text line", text_line, frames);
+    bench("log line", log_line, frames);
+    bench("fb scribble", scribble, frames);
+    bench("progress bar", progress_bar, frames);
+
+    gr_exit();
+    unlink(fb_path);
+    unlink(cmdline_path);
+
+    if (failures)
+        printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}